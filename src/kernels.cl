@@ -1,193 +1,622 @@
+// The kernels are built once for each element type and vector width, set by the host with
+// -D TYPE=<scalar type> -D VECWIDTH=<1, 2, 4, 8 or 16>. The defaults match the original double kernels.
+#ifndef TYPE
+#define TYPE double
+#endif
+#ifndef VECWIDTH
+#define VECWIDTH 1
+#endif
+
 // enable extension for OpenCL 1.1 and lower
-#if __OPENCL_VERSION__ < 120
+#if __OPENCL_VERSION__ < 120 && defined(cl_khr_fp64)
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
 #endif
+// half arithmetic always needs the extension enabled
+#ifdef cl_khr_fp16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+
+// Vector type of the kernels, eg. double4. Width 1 is the scalar type itself.
+#define CONCAT(a, b) a##b
+#define VECTYPE(T, W) CONCAT(T, W)
+#if VECWIDTH == 1
+#define VTYPE TYPE
+#else
+#define VTYPE VECTYPE(TYPE, VECWIDTH)
+#endif
+
+// The kernels timed by the host's TimeLocalSize take the number of work-items n as their last argument. The
+// global size is rounded up to whole work-groups, and the work-items from n on do nothing.
+
+
 
 // Initialize arrays
-__kernel void initialiseArraysKernel(__global double * restrict A,
-                                     __global double * restrict B,
-                                     __global double * restrict C)
+__kernel void initialiseArraysKernel(__global TYPE * restrict A,
+                                     __global TYPE * restrict B,
+                                     __global TYPE * restrict C)
 {
 	size_t tid = get_global_id(0);
 
-	A[tid] = 1.0;
-	B[tid] = 2.0;
-	C[tid] = 0.0;
+	A[tid] = (TYPE)1;
+	B[tid] = (TYPE)2;
+	C[tid] = (TYPE)0;
 
 }
 
 
 
-// Copy kernels
-__kernel void copyKernel1(__global const double * restrict A,
-                          __global double * restrict C)
+// Empty kernel, for launch overhead
+__kernel void emptyKernel(void)
 {
-	size_t tid = get_global_id(0);
-
-	C[tid] = A[tid];
 }
-__kernel void copyKernel2(__global const double2 * restrict A,
-                          __global double2 * restrict C)
+
+
+
+// Copy kernel
+__kernel void copyKernel(__global const VTYPE * restrict A,
+                         __global VTYPE * restrict C,
+                         const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
 	C[tid] = A[tid];
 }
-__kernel void copyKernel4(__global const double4 * restrict A,
-                          __global double4 * restrict C)
+
+
+
+// Scale kernel
+__kernel void scaleKernel(const TYPE scalar,
+                          __global VTYPE * restrict B,
+                          __global const VTYPE * restrict C,
+                          const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	C[tid] = A[tid];
+	B[tid] = scalar*C[tid];
 }
-__kernel void copyKernel8(__global const double8 * restrict A,
-                          __global double8 * restrict C)
+
+
+
+// Add kernel
+__kernel void addKernel(__global const VTYPE * restrict A,
+                        __global const VTYPE * restrict B,
+                        __global VTYPE * restrict C,
+                        const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	C[tid] = A[tid];
+	C[tid] = A[tid] + B[tid];
 }
-__kernel void copyKernel16(__global const double16 * restrict A,
-                          __global double16 * restrict C)
+
+
+
+// Triad kernel
+__kernel void triadKernel(const TYPE scalar,
+                          __global VTYPE * restrict A,
+                          __global const VTYPE * restrict B,
+                          __global const VTYPE * restrict C,
+                          const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	C[tid] = A[tid];
+	A[tid] = B[tid]*scalar + C[tid];
 }
 
 
 
-// Scale kernels
-__kernel void scaleKernel1(const double scalar,
-                           __global double * restrict B,
-                           __global const double * restrict C)
+// Read and write bandwidth. readKernel sums nItems items of X per work-item, spaced by n items, and writes
+// the sum so the loads stay live. fillKernel only writes. ratioKernel reads nReads items and writes nWrites items
+// per work-item, from and to blocks of m items of X and Y. The non-temporal variants are built where the compiler
+// has a builtin for streaming stores.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_nontemporal_store)
+#define HAVE_NONTEMPORAL_STORE
+#endif
+#endif
+#define STORE(p, v) (*(p) = (v))
+#define STORE_NONTEMPORAL(p, v) __builtin_nontemporal_store((v), (p))
+
+__kernel void readKernel(__global const VTYPE * restrict X,
+                         __global VTYPE * restrict Y,
+                         const uint nItems,
+                         const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
+	VTYPE sum = X[tid];
+
+	for (uint u = 1; u < nItems; u++) {
+		sum += X[tid + u*n];
+	}
+	Y[tid] = sum;
+}
 
-	B[tid] = scalar*C[tid];
+#define FILL_KERNEL(NAME, STOREOP) \
+__kernel void NAME(__global VTYPE * restrict Y, \
+                   const TYPE value, \
+                   const ulong n) \
+{ \
+	if (get_global_id(0) >= n) return; \
+	STOREOP(&Y[get_global_id(0)], (VTYPE)value); \
+}
+
+#define RATIO_KERNEL(NAME, STOREOP) \
+__kernel void NAME(__global const VTYPE * restrict X, \
+                   __global VTYPE * restrict Y, \
+                   const ulong m, \
+                   const uint nReads, \
+                   const uint nWrites, \
+                   const ulong n) \
+{ \
+	const size_t tid = get_global_id(0); \
+	if (tid >= n) return; \
+	VTYPE sum = X[tid]; \
+	for (uint r = 1; r < nReads; r++) { \
+		sum += X[r*m + tid]; \
+	} \
+	for (uint w = 0; w < nWrites; w++) { \
+		STOREOP(&Y[w*m + tid], sum); \
+	} \
 }
-__kernel void scaleKernel2(const double scalar,
-                           __global double2 * restrict B,
-                           __global const double2 * restrict C)
+
+FILL_KERNEL(fillKernel, STORE)
+RATIO_KERNEL(ratioKernel, STORE)
+#ifdef HAVE_NONTEMPORAL_STORE
+FILL_KERNEL(fillNontemporalKernel, STORE_NONTEMPORAL)
+RATIO_KERNEL(ratioNontemporalKernel, STORE_NONTEMPORAL)
+#endif
+
+
+
+// Strided copy and triad: work-item i accesses item i*stride, so a launch touches n/stride items of each array
+__kernel void copyStridedKernel(__global const TYPE * restrict A,
+                                __global TYPE * restrict C,
+                                const ulong stride,
+                                const ulong n)
 {
-	size_t tid = get_global_id(0);
+	if (get_global_id(0) >= n) return;
+	const size_t i = get_global_id(0)*stride;
 
-	B[tid] = scalar*C[tid];
+	C[i] = A[i];
 }
-__kernel void scaleKernel4(const double scalar,
-                           __global double4 * restrict B,
-                           __global const double4 * restrict C)
+
+__kernel void triadStridedKernel(const TYPE scalar,
+                                 __global TYPE * restrict A,
+                                 __global const TYPE * restrict B,
+                                 __global const TYPE * restrict C,
+                                 const ulong stride,
+                                 const ulong n)
 {
-	size_t tid = get_global_id(0);
+	if (get_global_id(0) >= n) return;
+	const size_t i = get_global_id(0)*stride;
 
-	B[tid] = scalar*C[tid];
+	A[i] = B[i]*scalar + C[i];
 }
-__kernel void scaleKernel8(const double scalar,
-                           __global double8 * restrict B,
-                           __global const double8 * restrict C)
+
+
+
+// Copy and triad starting offset items into the arrays. The offset needn't be a whole number of vectors, so the
+// vectors go through vloadn and vstoren, which only need the items themselves aligned.
+#if VECWIDTH == 1
+#define VLOAD(i, p) ((p)[i])
+#define VSTORE(v, i, p) ((p)[i] = (v))
+#else
+#define VLOAD(i, p) VECTYPE(vload, VECWIDTH)(i, p)
+#define VSTORE(v, i, p) VECTYPE(vstore, VECWIDTH)(v, i, p)
+#endif
+
+__kernel void copyOffsetKernel(__global const TYPE * restrict A,
+                               __global TYPE * restrict C,
+                               const ulong offset,
+                               const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	B[tid] = scalar*C[tid];
+	VSTORE(VLOAD(tid, A + offset), tid, C + offset);
 }
-__kernel void scaleKernel16(const double scalar,
-                           __global double16 * restrict B,
-                           __global const double16 * restrict C)
+
+__kernel void triadOffsetKernel(const TYPE scalar,
+                                __global TYPE * restrict A,
+                                __global const TYPE * restrict B,
+                                __global const TYPE * restrict C,
+                                const ulong offset,
+                                const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	B[tid] = scalar*C[tid];
+	VSTORE(VLOAD(tid, B + offset)*scalar + VLOAD(tid, C + offset), tid, A + offset);
 }
 
 
 
-// Add kernels
-__kernel void addKernel1(__global const double * restrict A,
-                         __global const double * restrict B,
-                         __global double * restrict C)
+// Gather and scatter through an index buffer made by indexKernel
+__kernel void gatherKernel(__global const TYPE * restrict A,
+                           __global TYPE * restrict C,
+                           __global const uint * restrict idx,
+                           const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	C[tid] = A[tid] + B[tid];
+	C[tid] = A[idx[tid]];
 }
-__kernel void addKernel2(__global const double2 * restrict A,
-                         __global const double2 * restrict B,
-                         __global double2 * restrict C)
+
+__kernel void scatterKernel(__global const TYPE * restrict A,
+                            __global TYPE * restrict C,
+                            __global const uint * restrict idx,
+                            const ulong n)
 {
 	size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	C[tid] = A[tid] + B[tid];
+	C[idx[tid]] = A[tid];
 }
-__kernel void addKernel4(__global const double4 * restrict A,
-                         __global const double4 * restrict B,
-                         __global double4 * restrict C)
+
+
+
+// Pseudo-random permutation of [0, n). A 4 round Feistel network permutes the 2*halfBits bit numbers, and values
+// of n or more are put through it again until they land in range (cycle walking), so 4^halfBits must be >= n.
+ulong permuteIndex(ulong x, const ulong n, const uint halfBits, const uint seed)
 {
-	size_t tid = get_global_id(0);
+	const ulong mask = ((ulong)1 << halfBits) - 1;
+	do {
+		ulong l = x >> halfBits;
+		ulong r = x & mask;
+		for (uint round = 0; round < 4; round++) {
+			const ulong f = ((r + seed + round)*0x9E3779B97F4A7C15UL) >> 32;
+			const ulong t = r;
+			r = l ^ (f & mask);
+			l = t;
+		}
+		x = (l << halfBits) | r;
+	} while (x >= n);
+	return x;
+}
 
-	C[tid] = A[tid] + B[tid];
+// Fill idx with a permutation of [0, n) that shuffles within blocks of blockSize items. A block size of 1 gives
+// the sequential pattern, and a block size of n a fully random one.
+__kernel void indexKernel(__global uint * restrict idx,
+                          const ulong n,
+                          const ulong blockSize,
+                          const uint halfBits,
+                          const uint seed)
+{
+	const size_t i = get_global_id(0);
+	const ulong block = i/blockSize;
+	const ulong base = block*blockSize;
+
+	idx[i] = base + permuteIndex(i - base, min(blockSize, n - base), halfBits, seed ^ (uint)block);
 }
-__kernel void addKernel8(__global const double8 * restrict A,
-                         __global const double8 * restrict B,
-                         __global double8 * restrict C)
+
+
+
+// Local memory copy and triad. Each work-item stages one item of each array in local memory, at stride items
+// apart so that strides of 2 or more make work-items share banks. Each repeat then goes through two steps
+// separated by barriers. In each step a work-item reads the items of another work-item (an offset that changes
+// with the repeat) and writes its own, so no step can be optimised away. Tiles hold local size * stride items.
+// Every work-item has to reach the barriers, so work-items from n on stage zeros and skip only the global store.
+#define LOCAL_INDEX(offset) (((get_local_id(0) + (offset)) % get_local_size(0))*stride)
+
+__kernel void copyLocalKernel(__global const TYPE * restrict A,
+                              __global TYPE * restrict C,
+                              __local TYPE * restrict tileA,
+                              __local TYPE * restrict tileC,
+                              const uint stride,
+                              const uint nRepeats,
+                              const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t i = get_local_id(0)*stride;
+	const int active = get_global_id(0) < n;
+
+	tileA[i] = active ? A[get_global_id(0)] : (TYPE)0;
+	for (uint r = 0; r < nRepeats; r++) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tileC[i] = tileA[LOCAL_INDEX(r + 1)];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tileA[i] = tileC[LOCAL_INDEX(r + 2)];
+	}
+	if (active) C[get_global_id(0)] = tileA[i];
+}
 
-	C[tid] = A[tid] + B[tid];
+__kernel void triadLocalKernel(const TYPE scalar,
+                               __global TYPE * restrict A,
+                               __global const TYPE * restrict B,
+                               __global const TYPE * restrict C,
+                               __local TYPE * restrict tileA,
+                               __local TYPE * restrict tileB,
+                               __local TYPE * restrict tileC,
+                               const uint stride,
+                               const uint nRepeats,
+                               const ulong n)
+{
+	const size_t i = get_local_id(0)*stride;
+	const int active = get_global_id(0) < n;
+
+	tileB[i] = active ? B[get_global_id(0)] : (TYPE)0;
+	tileC[i] = active ? C[get_global_id(0)] : (TYPE)0;
+	for (uint r = 0; r < nRepeats; r++) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tileA[i] = tileB[LOCAL_INDEX(r + 1)]*scalar + tileC[LOCAL_INDEX(r + 1)];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tileC[i] = tileB[LOCAL_INDEX(r + 2)]*scalar + tileA[LOCAL_INDEX(r + 2)];
+	}
+	if (active) A[get_global_id(0)] = tileC[i];
 }
-__kernel void addKernel16(__global const double16 * restrict A,
-                         __global const double16 * restrict B,
-                         __global double16 * restrict C)
+
+
+
+// Constant memory copy and triad. Each work-item reads nRepeats items of the constant array A, of mask + 1 items,
+// and sums them. With spread 0 all work-items read the same item at once (a broadcast), with spread 1 each reads
+// a different one.
+__kernel void copyConstantKernel(__constant TYPE * restrict A,
+                                 __global TYPE * restrict C,
+                                 const uint mask,
+                                 const uint spread,
+                                 const uint nRepeats,
+                                 const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
+	TYPE sum = (TYPE)0;
+
+	for (uint r = 0; r < nRepeats; r++) {
+		sum += A[(r + tid*spread) & mask];
+	}
+	C[tid] = sum;
+}
 
-	C[tid] = A[tid] + B[tid];
+__kernel void triadConstantKernel(const TYPE scalar,
+                                  __constant TYPE * restrict B,
+                                  __global TYPE * restrict C,
+                                  const uint mask,
+                                  const uint spread,
+                                  const uint nRepeats,
+                                  const ulong n)
+{
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
+	TYPE sum = (TYPE)0;
+
+	for (uint r = 0; r < nRepeats; r++) {
+		sum = B[(r + tid*spread) & mask]*scalar + sum;
+	}
+	C[tid] = sum;
 }
 
 
 
-// Triad kernels
-__kernel void triadKernel1(const double scalar,
-                           __global double * restrict A,
-                           __global const double * restrict B,
-                           __global const double * restrict C)
+// Image copy and triad, reading float4 pixels through the texture path. The 2D images are read with a sampler,
+// at the pixel of the work-item in rows of width pixels. Image buffers are read by index, as they can't take a
+// sampler. The output is an ordinary buffer.
+#ifdef __IMAGE_SUPPORT__
+__constant sampler_t imageSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+__kernel void copyImage2dKernel(__read_only image2d_t A,
+                                __global float4 * restrict C,
+                                const uint width,
+                                const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
+	const int2 coord = (int2)((int)(tid % width), (int)(tid / width));
 
-	A[tid] = B[tid]*scalar + C[tid];
+	C[tid] = read_imagef(A, imageSampler, coord);
 }
-__kernel void triadKernel2(const double scalar,
-                           __global double2 * restrict A,
-                           __global const double2 * restrict B,
-                           __global const double2 * restrict C)
+
+__kernel void triadImage2dKernel(const float scalar,
+                                 __global float4 * restrict A,
+                                 __read_only image2d_t B,
+                                 __read_only image2d_t C,
+                                 const uint width,
+                                 const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
+	const int2 coord = (int2)((int)(tid % width), (int)(tid / width));
 
-	A[tid] = B[tid]*scalar + C[tid];
+	A[tid] = read_imagef(B, imageSampler, coord)*scalar + read_imagef(C, imageSampler, coord);
 }
-__kernel void triadKernel4(const double scalar,
-                           __global double4 * restrict A,
-                           __global const double4 * restrict B,
-                           __global const double4 * restrict C)
+
+#if __OPENCL_VERSION__ >= 120
+__kernel void copyImageBufferKernel(__read_only image1d_buffer_t A,
+                                    __global float4 * restrict C,
+                                    const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	A[tid] = B[tid]*scalar + C[tid];
+	C[tid] = read_imagef(A, (int)tid);
 }
-__kernel void triadKernel8(const double scalar,
-                           __global double8 * restrict A,
-                           __global const double8 * restrict B,
-                           __global const double8 * restrict C)
+
+__kernel void triadImageBufferKernel(const float scalar,
+                                     __global float4 * restrict A,
+                                     __read_only image1d_buffer_t B,
+                                     __read_only image1d_buffer_t C,
+                                     const ulong n)
 {
-	size_t tid = get_global_id(0);
+	const size_t tid = get_global_id(0);
+	if (tid >= n) return;
 
-	A[tid] = B[tid]*scalar + C[tid];
+	A[tid] = read_imagef(B, (int)tid)*scalar + read_imagef(C, (int)tid);
 }
-__kernel void triadKernel16(const double scalar,
-                           __global double16 * restrict A,
-                           __global const double16 * restrict B,
-                           __global const double16 * restrict C)
+#endif
+#endif
+
+
+
+// Pointer chase. chaseInitKernel links the n items of next into a single cycle in random order: the item at
+// position i of a random permutation points to the one at position i + 1. 4^halfBits must be >= n.
+__kernel void chaseInitKernel(__global uint * restrict next,
+                              const ulong n,
+                              const uint halfBits,
+                              const uint seed)
 {
-	size_t tid = get_global_id(0);
+	const size_t i = get_global_id(0);
 
-	A[tid] = B[tid]*scalar + C[tid];
+	next[permuteIndex(i, n, halfBits, seed)] = permuteIndex(i + 1 < n ? i + 1 : 0, n, halfBits, seed);
+}
+
+// Each work-item follows its own chain through the list for nLoads loads, starting from points spread over the
+// list. Each load needs the result of the one before, so the time per load is the memory latency. The end of each
+// chain is written to sink so that the loads can't be optimised away.
+__kernel void chaseKernel(__global const uint * restrict next,
+                          const ulong n,
+                          const ulong nLoads,
+                          __global uint * restrict sink)
+{
+	const size_t chain = get_global_id(0);
+	uint p = chain*(n/get_global_size(0));
+
+	for (ulong i = 0; i < nLoads; i++) {
+		p = next[p];
+	}
+	sink[chain] = p;
+}
+
+
+
+// Grid-stride kernels. A fixed number of work-items, set by the host, loops over the n items of the arrays.
+// Each iteration handles U items spaced by the grid size, so neighbouring work-items still access neighbouring
+// items. The remainder loop picks up the items left over when n is not a multiple of U times the grid size.
+#define GRIDSTRIDE_LOOP(U, BODY) \
+	const size_t stride = get_global_size(0); \
+	size_t i = get_global_id(0); \
+	for (; i + (U-1)*stride < n; i += U*stride) { \
+		for (int u = 0; u < U; u++) { \
+			const size_t j = i + u*stride; \
+			BODY; \
+		} \
+	} \
+	for (; i < n; i += stride) { \
+		const size_t j = i; \
+		BODY; \
+	}
+
+#define GRIDSTRIDE_KERNELS(U) \
+__kernel void copyGridKernel_##U(__global const VTYPE * restrict A, \
+                                 __global VTYPE * restrict C, \
+                                 const ulong n) \
+{ \
+	GRIDSTRIDE_LOOP(U, C[j] = A[j]) \
+} \
+__kernel void scaleGridKernel_##U(const TYPE scalar, \
+                                  __global VTYPE * restrict B, \
+                                  __global const VTYPE * restrict C, \
+                                  const ulong n) \
+{ \
+	GRIDSTRIDE_LOOP(U, B[j] = scalar*C[j]) \
+} \
+__kernel void addGridKernel_##U(__global const VTYPE * restrict A, \
+                                __global const VTYPE * restrict B, \
+                                __global VTYPE * restrict C, \
+                                const ulong n) \
+{ \
+	GRIDSTRIDE_LOOP(U, C[j] = A[j] + B[j]) \
+} \
+__kernel void triadGridKernel_##U(const TYPE scalar, \
+                                  __global VTYPE * restrict A, \
+                                  __global const VTYPE * restrict B, \
+                                  __global const VTYPE * restrict C, \
+                                  const ulong n) \
+{ \
+	GRIDSTRIDE_LOOP(U, A[j] = B[j]*scalar + C[j]) \
+}
+
+GRIDSTRIDE_KERNELS(1)
+GRIDSTRIDE_KERNELS(2)
+GRIDSTRIDE_KERNELS(4)
+GRIDSTRIDE_KERNELS(8)
+
+
+
+// Verification. verifyKernel checks n items of X against the expected value with a grid-stride loop. Each
+// work-group then reduces its count of items out of tolerance, the lowest index of those, and the summed absolute
+// error, in local memory. verifyReduceKernel, run as a single work-group, combines the per-group results into
+// element 0 of the same buffers, so only a few bytes are read back. Local sizes must be powers of two. The error
+// is summed in ERRTYPE, double where the device has it and float otherwise, since a sum in half, int or long
+// overflows or loses the small errors.
+#ifdef cl_khr_fp64
+#define ERRTYPE double
+#else
+#define ERRTYPE float
+#endif
+#define VERIFY_REDUCE(errors, first, errSum) \
+	const size_t lid = get_local_id(0); \
+	localErrors[lid] = errors; \
+	localFirst[lid] = first; \
+	localErrSum[lid] = errSum; \
+	for (size_t s = get_local_size(0)/2; s > 0; s /= 2) { \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if (lid < s) { \
+			localErrors[lid] += localErrors[lid + s]; \
+			localFirst[lid] = min(localFirst[lid], localFirst[lid + s]); \
+			localErrSum[lid] += localErrSum[lid + s]; \
+		} \
+	}
+
+__kernel void verifyKernel(__global const TYPE * restrict X,
+                           const TYPE expected,
+                           const TYPE tolerance,
+                           const ulong n,
+                           __global ulong * restrict groupErrors,
+                           __global ulong * restrict groupFirst,
+                           __global ERRTYPE * restrict groupErrSum,
+                           __local ulong * restrict localErrors,
+                           __local ulong * restrict localFirst,
+                           __local ERRTYPE * restrict localErrSum)
+{
+	ulong errors = 0;
+	ulong first = ULONG_MAX;
+	ERRTYPE errSum = (ERRTYPE)0;
+
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+		const TYPE diff = X[i] > expected ? X[i] - expected : expected - X[i];
+		// Written this way round so that NaNs count as errors, as do integer differences that overflowed
+		if (!(diff <= tolerance) || diff < (TYPE)0) {
+			if (errors == 0) first = i;
+			errors++;
+		}
+		errSum += X[i] > expected ? (ERRTYPE)X[i] - (ERRTYPE)expected : (ERRTYPE)expected - (ERRTYPE)X[i];
+	}
+
+	VERIFY_REDUCE(errors, first, errSum)
+
+	if (lid == 0) {
+		groupErrors[get_group_id(0)] = localErrors[0];
+		groupFirst[get_group_id(0)] = localFirst[0];
+		groupErrSum[get_group_id(0)] = localErrSum[0];
+	}
+}
+
+__kernel void verifyReduceKernel(__global ulong * restrict groupErrors,
+                                 __global ulong * restrict groupFirst,
+                                 __global ERRTYPE * restrict groupErrSum,
+                                 const ulong nGroups,
+                                 __local ulong * restrict localErrors,
+                                 __local ulong * restrict localFirst,
+                                 __local ERRTYPE * restrict localErrSum)
+{
+	ulong errors = 0;
+	ulong first = ULONG_MAX;
+	ERRTYPE errSum = (ERRTYPE)0;
+
+	for (size_t i = get_local_id(0); i < nGroups; i += get_local_size(0)) {
+		errors += groupErrors[i];
+		first = min(first, groupFirst[i]);
+		errSum += groupErrSum[i];
+	}
+
+	VERIFY_REDUCE(errors, first, errSum)
+
+	if (lid == 0) {
+		groupErrors[0] = localErrors[0];
+		groupFirst[0] = localFirst[0];
+		groupErrSum[0] = localErrSum[0];
+	}
 }
@@ -1,12 +1,17 @@
-// TODO: - improve verification. Currently only the last iteration of the double16 kernels leaves
-//         permenent data in the arrays. Stream interleaves all of the tests... not too hard to do here?
-//       - configurable float/double?
-//       - automatically run up to max work group size for current device?
-
+#define _GNU_SOURCE      // pthread_setaffinity_np()
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>        // clock_gettime()
-#include <float.h>       // DBL_MIN
+#include <float.h>       // DBL_MAX
+#include <math.h>        // fabs()
+#include <getopt.h>      // getopt_long()
+#include <string.h>      // strcmp(), strstr()
+#include <pthread.h>     // multi-device test and native baseline threads
+#include <sched.h>       // sched_getaffinity()
+#include <errno.h>
+#include <signal.h>      // signal(), to stop the monitoring mode
+#include <unistd.h>      // sysconf(), close()
+#include <sys/stat.h>    // mkdir(), fchmod()
 
 /* clCreateCommandQueue with 2.0 headers gives a warning about it being deprecated, avoid it */
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
@@ -14,298 +19,4097 @@
 #include <CL/opencl.h>
 
 
-// Array size for tests. Needs to be big to sufficiently load device.
-// Must be divisible by 16 (the largest vector type) and 256 (the largest local workgroup size tested)
-#define TRYARRAYSIZE (0.5 * 1024*1024*1024/8)
+// Array size for tests, in bytes. Needs to be big to sufficiently load device.
+// Number of items must be divisible by 16 (the largest vector type)
+#define TRYARRAYBYTES (0.5 * 1024*1024*1024)
+
+// Number of times to run tests
+#define NTIMES 50
+
+// Untimed launches before each timed batch (--warmup). The STREAM table's timings repeat adaptively, in batches
+// of NTIMES launches until the 95% confidence interval of the median is within CITARGET of it (--ci-target), the
+// time budget in seconds is spent (--time-budget), or MAXTIMES launches are timed. Other modes time one batch.
+#define WARMUPTIMES 1
+#define CITARGET 0.01
+#define TIMEBUDGET 1.0
+#define MAXTIMES 10000
+
+// Smallest array size in bytes, and maximum number of steps, of the array size sweep
+#define SWEEPMINSIZE 4096
+#define SWEEPMAXSTEPS 128
+
+// Grid-stride test: work-items per work-group, work-groups per compute unit tried, unroll factors compiled
+// into kernels.cl, and number of launches timed for each configuration
+#define GRIDLOCALSIZE 64
+#define NOCCUPANCIES 7
+const size_t occupancies[NOCCUPANCIES] = {1, 2, 4, 8, 16, 32, 64};
+#define NUNROLLS 4
+const int unrolls[NUNROLLS] = {1, 2, 4, 8};
+#define GRIDNTIMES 10
+
+// Access pattern test: strides of the strided kernels, block size of the blocked shuffle, seed of the
+// index permutations, and cache line size assumed if the device doesn't report one
+#define NSTRIDES 11
+const size_t strides[NSTRIDES] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+#define SHUFFLEBLOCKSIZE 1024
+#define PATTERNSEED 0x2545f491
+#define DEFAULTCACHELINE 64
+
+// Memory space test: most work-items of the local and constant memory kernels, repeated accesses of each
+// work-item, local size and strides of the local memory kernels, smallest constant buffer in bytes, width of the
+// 2D images, and launches timed of the local memory kernels
+#define MEMSPACEITEMS (1 << 22)
+#define LOCALREPEATS 64
+#define CONSTANTREPEATS 64
+#define LOCALTILESIZE 256
+#define NLOCALSTRIDES 6
+const cl_uint localStrides[NLOCALSTRIDES] = {1, 2, 4, 8, 16, 32};
+#define CONSTANTMINBYTES 1024
+#define IMAGEWIDTH 4096
+#define MEMSPACENTIMES 10
+
+// Read/write test: items summed by each work-item of the read-only kernel, and most reads or writes per
+// work-item of the ratio kernels
+#define READITEMS 64
+#define MAXRATIO 4
+
+// Latency test: smallest list footprint in bytes, dependent loads per chain and launches timed at each point,
+// chain counts of the footprint table, most chains of the loaded latency table, and least list items per chain
+#define CHASEMINBYTES 4096
+#define CHASELOADS (1 << 16)
+#define CHASENTIMES 3
+#define NCHASECHAINS 7
+const size_t chaseChains[NCHASECHAINS] = {1, 4, 16, 64, 256, 1024, 4096};
+#define CHASEMAXCHAINS 65536
+#define CHASEMINSPACING 16
+
+// Transfer test: smallest transfer in bytes (sizes go up in factors of 4 to the array size), number of
+// transfers timed at each size, and alignment of the CL_MEM_USE_HOST_PTR host memory
+#define TRANSFERMINSIZE 1024
+#define TRANSFERNTIMES 20
+#define HOSTPTRALIGN 4096
+
+// Out-of-core test: smallest chunk in bytes (chunks go up in factors of 4), most chunk buffers in the pipeline
+// (each with its own queue), and the largest fraction of host memory the three host arrays may take
+#define OOCMINCHUNK (1024*1024)
+#define OOCMAXBUFFERS 3
+#define OOCHOSTFRACTION 0.75
+
+// Launch test: empty kernels enqueued for the throughput, launches timed for each latency, smallest triad
+// array in bytes of the crossover sweep (sizes double up to the array size), and launches timed at each size
+#define LAUNCHBATCH 10000
+#define LAUNCHTIMES 1000
+#define CROSSOVERMINBYTES 1024
+#define CROSSOVERTIMES 20
+
+// Alignment test: cache lines the array offsets go up to, and most offsets timed (the step between offsets goes up
+// from one item to keep within this)
+#define ALIGNCACHELINES 2
+#define ALIGNMAXOFFSETS 64
+
+// Monitoring mode: seconds between samples, and most of the time spent sampling. Each sample times MONITORLAUNCHES
+// triad launches and a pointer chase through a list of up to MONITORCHASEBYTES. The baseline is the median of the
+// last MONITORWINDOW samples that weren't low, and drops are only looked for once it has MONITORMINBASELINE. A sample
+// more than MONITORDROP below the baseline is low, and MONITORSUSTAIN low samples in a row are a sustained drop.
+#define MONITORINTERVAL 60.0
+#define MONITORDUTYCYCLE 0.01
+#define MONITORLAUNCHES 10
+#define MONITORCHASEBYTES (256*1024*1024)
+#define MONITORWINDOW 30
+#define MONITORMINBASELINE 5
+#define MONITORDROP 0.1
+#define MONITORSUSTAIN 3
+#define MONITORJSONFILE "opencl-stream.jsonl"
+#define MONITORPROMFILE "opencl-stream.prom"
+
+// Native baseline: the AVX2 and AVX-512 kernels are only built for x86 with GCC or clang. The scalar kernels
+// have vectorisation turned off, by function attribute for GCC and by loop pragma for clang.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NATIVE_X86
+#endif
+#if defined(__clang__)
+#define NATIVE_SCALAR_ATTR
+#define NATIVE_SCALAR_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#elif defined(__GNUC__)
+#define NATIVE_SCALAR_ATTR __attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+#define NATIVE_SCALAR_LOOP
+#else
+#define NATIVE_SCALAR_ATTR
+#define NATIVE_SCALAR_LOOP
+#endif
+
+// Concurrent tests: most command queues on one device, and most devices
+#define MAXQUEUES 64
+#define MAXDEVICES 16
+
+// Work-group size autotuner: launches of each candidate local size in the first round, how much slower than
+// the best a candidate may be to go through to the adaptively repeated round, and the most that go through
+#define TUNEPROBETIMES 5
+#define TUNEPRUNEFACTOR 1.15
+#define TUNEMAXFINALISTS 4
+// Candidates are each multiple of the preferred work-group size multiple up to TUNEMAXMULTIPLES of it, then
+// steps of about sqrt(2) up to the largest local size the kernel allows
+#define TUNEMAXMULTIPLES 16
+#define MAXTUNECANDIDATES 64
+
+// Offset basis of the FNV-1a hash used for program cache keys
+#define FNVOFFSET 0xcbf29ce484222325ULL
+
+// Verification: work-groups of the first reduction pass, and their largest local size. The STREAM-style
+// validation runs up to VALIDATENTIMES iterations, fewer if the values would leave the element type's range.
+#define VERIFYGROUPS 256
+#define VERIFYLOCALSIZE 256
+#define VALIDATENTIMES 10
+
+// Print per-local-size results during test?
+//#define VERBOSE
+
+// Long-only command line options
+enum {OPT_CACHEDIR = 256, OPT_NOCACHE, OPT_TUNINGFILE, OPT_RETUNE, OPT_WARMUP, OPT_CITARGET, OPT_TIMEBUDGET, OPT_INTERVAL,
+      OPT_DUTYCYCLE, OPT_SAMPLES, OPT_DROPTHRESHOLD, OPT_JSONFILE, OPT_PROMFILE};
+
+// Test modes, chosen on the command line
+enum {MODE_STREAM, MODE_SWEEP, MODE_GRIDSTRIDE, MODE_TRANSFER, MODE_CONCURRENT, MODE_MULTIDEVICE, MODE_VALIDATE, MODE_PATTERNS, MODE_LATENCY, MODE_MEMSPACES, MODE_READWRITE, MODE_OUTOFCORE, MODE_ALLOC, MODE_NATIVE, MODE_LAUNCH, MODE_ALIGNMENT, MODE_FISSION, MODE_MONITOR};
+
+// The stream kernels, and the vector widths each is available in
+enum {COPY, SCALE, ADD, TRIAD, NSTREAMKERNELS};
+#define NVECWIDTHS 5
+const size_t vecWidths[NVECWIDTHS] = {1, 2, 4, 8, 16};
+
+// Kernel name prefix, memory operations and flops per array item
+typedef struct {
+	const char *name;
+	int memops;
+	int flops;
+} StreamKernelInfo;
+const StreamKernelInfo streamKernelInfo[NSTREAMKERNELS] = {
+	{"copy",  2, 0},
+	{"scale", 2, 1},
+	{"add",   3, 1},
+	{"triad", 3, 2}
+};
+
+// Index patterns of the gather and scatter kernels
+enum {PATTERN_SEQUENTIAL, PATTERN_BLOCKED, PATTERN_RANDOM, NPATTERNS};
+const char * const patternNames[NPATTERNS] = {"Sequential", "Blocked", "Random"};
+
+// Host<->device transfer methods
+enum {TRANSFER_PAGEABLE, TRANSFER_PINNED, TRANSFER_HOSTPTR, TRANSFER_MAP, TRANSFER_DEVICECOPY, NTRANSFERS};
+const char * const transferNames[NTRANSFERS] = {
+	"Read/Write, malloc",
+	"Read/Write, pinned",
+	"Copy, USE_HOST_PTR",
+	"Map/Unmap",
+	"Copy, device to device"
+};
+
+// Array allocation flavours of the allocation test. The SVM ones need OpenCL 2.0.
+enum {ALLOC_BUFFER, ALLOC_ALLOCHOSTPTR, ALLOC_USEHOSTPTR, ALLOC_SVMCOARSE, ALLOC_SVMFINE, NALLOCS};
+const char * const allocNames[NALLOCS] = {"Buffer", "ALLOC_HOST_PTR", "USE_HOST_PTR", "Coarse SVM", "Fine SVM"};
+
+// Instruction sets of the native baseline kernels. Scalar is not vectorised, Default is vectorised for whatever
+// the compiler targets by default (eg. SSE2 on x86-64).
+enum {ISA_SCALAR, ISA_DEFAULT, ISA_AVX2, ISA_AVX512, NISAS};
+const char * const isaNames[NISAS] = {"Scalar", "Default", "AVX2", "AVX512"};
+
+// Element types the kernels can be built for, the device extension each needs, the largest value the
+// validation may reach, and the relative error allowed by verification
+enum {TYPE_DOUBLE, TYPE_FLOAT, TYPE_HALF, TYPE_INT, TYPE_LONG, NTYPES};
+typedef struct {
+	const char *name;
+	size_t size;
+	const char *extension;
+	double maxValue;
+	double epsilon;
+} ElementTypeInfo;
+const ElementTypeInfo elementTypes[NTYPES] = {
+	{"double", sizeof(cl_double), "cl_khr_fp64", 9007199254740992.0, 1.0e-13},
+	{"float",  sizeof(cl_float),  NULL,          FLT_MAX,            1.0e-5},
+	{"half",   sizeof(cl_half),   "cl_khr_fp16", 65504.0,            1.0e-2},
+	{"int",    sizeof(cl_int),    NULL,          2147483647.0,       0.0},
+	{"long",   sizeof(cl_long),   NULL,          9007199254740992.0, 0.0}
+};
+
+// Element type the kernels are built for, chosen on the command line
+int elementType = TYPE_DOUBLE;
+
+// Warm-up launches, and the confidence interval target and time budget of adaptive repetition
+int warmupTimes = WARMUPTIMES;
+double ciTarget = CITARGET;
+double timeBudget = TIMEBUDGET;
+
+// Monitoring mode: seconds between samples and most of the time spent sampling, samples to take (0 to run until
+// stopped), fraction below the baseline that is a drop, and the output files. monitorStop is set by SIGINT and SIGTERM.
+double monitorInterval = MONITORINTERVAL;
+double monitorDutyCycle = MONITORDUTYCYCLE;
+long monitorSamples = 0;
+double monitorDropThreshold = MONITORDROP;
+const char *monitorJsonFile = MONITORJSONFILE;
+const char *monitorPromFile = MONITORPROMFILE;
+volatile sig_atomic_t monitorStop = 0;
+
+// Directory of the compiled program cache, NULL if disabled
+char *programCacheDir = NULL;
+
+// Best local sizes found by the autotuner, loaded from the tuning file and saved to it as new ones are found.
+// Later entries for a key override earlier ones.
+typedef struct {
+	char key[1024];
+	size_t localSize;
+} TuningEntry;
+char *tuningFile = NULL;
+TuningEntry *tuningEntries = NULL;
+int nTuningEntries = 0;
+
+// Per-launch device times in seconds at the best local size (0 for the runtime's choice), the launch overhead,
+// and the number of array items each launch processed. The statistics are of nTimes timed launches: the 5th and
+// 95th percentiles, the half width of the median's 95% confidence interval relative to the median, and the
+// number of launches outside 1.5 interquartile ranges of the quartiles.
+typedef struct {
+	size_t bestLocalSize;
+	double minTime, avgTime, maxTime;
+	double medianTime, p5Time, p95Time, stdDevTime, medianCI;
+	int nTimes, nOutliers;
+	double queuedToSubmit, submitToStart;
+	size_t items;
+} TestResult;
+
+// Result of checking one array on the device: number of items out of tolerance, the index and value of the
+// first of them, and the average absolute error
+typedef struct {
+	cl_ulong errors, firstError;
+	double firstValue;
+	double avgAbsError;
+} VerifyResult;
+
+// State of one device's host thread in the multi-device and fission tests, and its wall times for each kernel.
+// The arrays are sized to a 1/nShares share of the device's memory, for sub-devices that share their parent's.
+typedef struct {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	cl_device_id device;
+	char name[128];
+	size_t vecWidth;
+	int nShares;
+	size_t arraySize;
+	int ok;
+	double startTime[NSTREAMKERNELS], endTime[NSTREAMKERNELS];
+} DeviceThread;
+
+// Native baseline kernel over n items of the arrays, and the state shared by the native threads: the task they
+// run next (a stream kernel, NATIVEINIT or NATIVEEXIT), the kernel functions and the arrays
+typedef void (*NativeKernel)(void *A, void *B, void *C, double scalar, size_t n);
+enum {NATIVEINIT = NSTREAMKERNELS, NATIVEEXIT};
+typedef struct {
+	pthread_barrier_t start, done;
+	int task;
+	NativeKernel kernels[NSTREAMKERNELS];
+	void *A, *B, *C;
+	double scalar;
+} NativePool;
+
+// One native thread: the CPU it is pinned to, and its part of the arrays
+typedef struct {
+	pthread_t thread;
+	NativePool *pool;
+	int cpu;
+	size_t start, n;
+} NativeThread;
+
+// One sample of the monitoring mode: wall time, median and best triad rate in GB/s, latency per load in ns, the
+// rolling baseline (0 until there is one), whether the sample is low, and whether a sustained drop is going on
+typedef struct {
+	double time;
+	double rate, bestRate;
+	double latency;
+	double baseline;
+	int low, dropping;
+} MonitorSample;
+
+// Function prototypes
+double GetWallTime(void);
+double GetEventTime(cl_event event, cl_profiling_info from, cl_profiling_info to);
+cl_ulong GetEventTimestamp(cl_event event, cl_profiling_info point);
+size_t GetArraySize(size_t sizeBytes, cl_ulong maxAlloc, cl_ulong globalMemSize);
+void PrintUsage(char *programName);
+void SetStreamKernelArgs(cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar);
+cl_uint SetStreamKernelArg(cl_kernel *kernel, int k, cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar);
+#ifdef CL_VERSION_2_0
+cl_uint SetStreamKernelArgSVM(cl_kernel *kernel, int k, void *A, void *B, void *C, double scalar);
+#endif
+void RunTest(cl_command_queue * queue, cl_kernel * kernel, size_t vecWidth, size_t arraySize, int adaptive, TestResult *result);
+int GetLocalSizeCandidates(cl_command_queue *queue, cl_kernel *kernel, size_t globalSize, size_t *candidates);
+void TimeLocalSize(cl_command_queue *queue, cl_kernel *kernel, size_t vecWidth, size_t arraySize, size_t localSize, int nTimes,
+                   int adaptive, TestResult *result);
+cl_int SetItemCountArg(cl_kernel *kernel, size_t nWorkItems);
+void TimeKernel(cl_command_queue *queue, cl_kernel *kernel, size_t globalSize, size_t localSize, int nTimes, int adaptive,
+                TestResult *result);
+void GetTimeStatistics(double *times, int nTimes, TestResult *result);
+int CompareDoubles(const void *a, const void *b);
+void PrintResult(char *testName, int memops, int flops, TestResult *result);
+void PrintStatistics(char *testName, int memops, TestResult *result);
+void FormatLocalSize(size_t localSize, char *string, size_t length);
+void RunSweep(cl_command_queue *queue, cl_kernel streamKernels[][NVECWIDTHS],
+              cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t maxArraySize);
+void RunGridStrideTest(cl_device_id *device, cl_command_queue *queue, cl_program programs[], cl_kernel streamKernels[][NVECWIDTHS],
+                       cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize);
+void RunPatternTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program *program,
+                    cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize);
+void PrintPatternResult(char *testName, double usefulBytes, double effectiveBytes, TestResult *result);
+void RunMemorySpaceTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program *program,
+                        cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C,
+                        double scalar, size_t arraySize);
+void PrintMemorySpaceResult(const char *testName, const char *memoryName, double bytesPerItem, TestResult *result);
+void RunReadWriteTest(cl_command_queue *queue, cl_program *program, cl_mem *device_A, cl_mem *device_C, double scalar,
+                      size_t arraySize, size_t vecWidth);
+void PrintReadWriteResult(const char *testName, int nReads, int nWrites, TestResult *result, TestResult *nontemporalResult);
+void RunLatencyTest(cl_command_queue *queue, cl_program *program, cl_mem *device_A, cl_mem *device_B, size_t maxBytes);
+void BuildChaseList(cl_command_queue *queue, cl_kernel *chaseInitKernel, cl_ulong n);
+double ChaseTime(cl_command_queue *queue, cl_kernel *chaseKernel, cl_ulong n, size_t nChains);
+int RunTransferTest(cl_context *context, cl_command_queue *queue, cl_mem *device_A, cl_mem *device_B, size_t maxBytes);
+int RunOutOfCoreTest(cl_device_id *device, cl_context *context, cl_program *program, cl_mem *device_A, cl_mem *device_B,
+                     cl_mem *device_C, double scalar, size_t deviceArrayBytes, cl_ulong globalMemSize, size_t vecWidth);
+void RunLaunchTest(cl_device_id *device, cl_context *context, cl_program programs[], cl_mem *device_A, cl_mem *device_B,
+                   cl_mem *device_C, double scalar, size_t arraySize, size_t vecWidth);
+void CL_CALLBACK LaunchCallback(cl_event event, cl_int status, void *data);
+void RunAlignmentTest(cl_device_id *device, cl_command_queue *queue, cl_program programs[], cl_mem *device_A,
+                      cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize);
+int RunAllocationTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program programs[],
+                      double scalar, size_t arraySize, size_t vecWidth);
+void ReleaseAllocArrays(cl_context *context, cl_mem *arrays, void **host, int svm);
+void RunConcurrentTest(cl_device_id *device, cl_context *context, cl_program *program, cl_mem *device_A, cl_mem *device_B,
+                       cl_mem *device_C, double scalar, size_t arraySize, size_t vecWidth, int nQueues);
+int RunMultiDeviceTest(char *devices, size_t vecWidth);
+void RunDeviceThreads(DeviceThread *threads, int nThreads);
+void *MultiDeviceThread(void *arg);
+double DeviceThreadRate(DeviceThread *dt, int k);
+int RunFissionTest(cl_device_id *device, size_t vecWidth);
+cl_int CreateSubDevices(cl_device_id *device, const cl_device_partition_property *properties, cl_device_id **subDevices,
+                        cl_uint *nSubDevices);
+void ReleaseSubDevices(cl_device_id *subDevices, cl_uint nSubDevices);
+int RunMonitor(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program programs[],
+               cl_kernel streamKernels[][NVECWIDTHS], size_t arraySize, size_t vecWidth);
+void MonitorSignal(int signum);
+void WriteMonitorRecord(FILE *file, const char *deviceName, size_t vecWidth, size_t localSize, long sample, MonitorSample *s);
+int WritePrometheusFile(const char *path, const char *deviceName, size_t vecWidth, MonitorSample *s, long nSamples,
+                        long nDrops);
+void PrintEscaped(FILE *file, const char *string);
+void FormatTimestamp(double time, char *string, size_t length);
+int RunNativeTest(cl_command_queue *queue, cl_kernel streamKernels[][NVECWIDTHS], double scalar, size_t arraySize,
+                  size_t vecWidth);
+int IsaSupported(int isa);
+void *NativeThreadMain(void *arg);
+double RunNativeTask(NativePool *pool, int task);
+int VerifyResults(cl_context *context, cl_program *program, cl_command_queue *queue, cl_mem *device_A, cl_mem *device_B,
+                  cl_mem *device_C, double scalar, size_t arraySize);
+int RunValidation(cl_context *context, cl_program programs[], cl_command_queue *queue, cl_kernel *initialiseArraysKernel,
+                  cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C,
+                  double scalar, size_t arraySize);
+void GetExpectedValues(double scalar, int nIterations, double *a, double *b, double *c);
+int VerifyArray(cl_context *context, cl_program *program, cl_command_queue *queue, cl_mem *X, double expected,
+                size_t arraySize, VerifyResult *result);
+void PrintVerifyFailure(char arrayName, VerifyResult *result, double expected, size_t arraySize);
+// Element type conversions
+cl_int SetScalarKernelArg(cl_kernel *kernel, cl_uint index, double value);
+double GetElement(const void *array, size_t i);
+void FillElements(void *array, size_t n, double value);
+cl_half FloatToHalf(float f);
+float HalfToFloat(cl_half h);
+// OpenCL Stuff
+int InitialiseCLEnvironment(cl_platform_id**, cl_device_id***, cl_device_id*, cl_context*, cl_command_queue*, cl_ulong*, cl_ulong*,
+                            const char*);
+int BuildProgram(cl_context *context, cl_device_id *device, size_t vecWidth, cl_program *program);
+void GetProgramCacheKey(cl_device_id *device, const char *options, const char *source, size_t sourceLength, char *key, size_t keyLength);
+int LoadCachedProgram(cl_context *context, cl_device_id *device, const char *options, const char *key, const char *cacheFile,
+                      cl_program *program, double *buildTime);
+void SaveCachedProgram(cl_program *program, const char *key, const char *cacheFile, double buildTime);
+cl_ulong HashBytes(const void *data, size_t length, cl_ulong hash);
+int MakeDirectory(const char *path);
+// Tuning file
+void GetTuningKey(cl_device_id *device, const char *testName, size_t arraySize, char *key, size_t keyLength);
+void LoadTuningFile(void);
+int LookupTuning(const char *key, size_t *localSize);
+void SaveTuning(const char *key, size_t localSize);
+int DeviceHasExtension(cl_device_id *device, const char *extension);
+void CleanUpCLEnvironment(cl_platform_id**, cl_device_id***, cl_context*, cl_command_queue*);
+void CheckOpenCLError(cl_int err, int line);
+
+const char * const kernelFileName = "src/kernels.cl";
+
+
+int main(int argc, char **argv)
+{
+	// Parse command line
+	int mode = MODE_STREAM;
+	int typeChosen = 0;
+	int nQueues = 1;
+	char *devices = NULL;
+	char *deviceChoice = NULL;
+	size_t vecWidth = 4;
+	int useCache = 1;
+	int retune = 0;
+	char defaultCacheDir[1024], defaultTuningFile[1100];
+	static struct option longOptions[] = {
+		{"sweep", no_argument, NULL, 's'},
+		{"gridstride", no_argument, NULL, 'g'},
+		{"transfer", no_argument, NULL, 'x'},
+		{"validate", no_argument, NULL, 'V'},
+		{"patterns", no_argument, NULL, 'p'},
+		{"latency", no_argument, NULL, 'l'},
+		{"memspaces", no_argument, NULL, 'M'},
+		{"readwrite", no_argument, NULL, 'r'},
+		{"outofcore", no_argument, NULL, 'o'},
+		{"alloc", no_argument, NULL, 'a'},
+		{"native", no_argument, NULL, 'n'},
+		{"launch", no_argument, NULL, 'L'},
+		{"alignment", no_argument, NULL, 'A'},
+		{"fission", no_argument, NULL, 'f'},
+		{"monitor", no_argument, NULL, 'D'},
+		{"device", required_argument, NULL, 'd'},
+		{"queues", required_argument, NULL, 'q'},
+		{"multidevice", required_argument, NULL, 'm'},
+		{"vecwidth", required_argument, NULL, 'w'},
+		{"type", required_argument, NULL, 't'},
+		{"cache-dir", required_argument, NULL, OPT_CACHEDIR},
+		{"no-cache", no_argument, NULL, OPT_NOCACHE},
+		{"tuning-file", required_argument, NULL, OPT_TUNINGFILE},
+		{"retune", no_argument, NULL, OPT_RETUNE},
+		{"warmup", required_argument, NULL, OPT_WARMUP},
+		{"ci-target", required_argument, NULL, OPT_CITARGET},
+		{"time-budget", required_argument, NULL, OPT_TIMEBUDGET},
+		{"interval", required_argument, NULL, OPT_INTERVAL},
+		{"duty-cycle", required_argument, NULL, OPT_DUTYCYCLE},
+		{"samples", required_argument, NULL, OPT_SAMPLES},
+		{"drop-threshold", required_argument, NULL, OPT_DROPTHRESHOLD},
+		{"json-file", required_argument, NULL, OPT_JSONFILE},
+		{"prom-file", required_argument, NULL, OPT_PROMFILE},
+		{"help",  no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "sgxVplMroanLAfDd:q:m:w:t:h", longOptions, NULL)) != -1) {
+		switch (opt) {
+			case 's': mode = MODE_SWEEP; break;
+			case 'g': mode = MODE_GRIDSTRIDE; break;
+			case 'x': mode = MODE_TRANSFER; break;
+			case 'V': mode = MODE_VALIDATE; break;
+			case 'p': mode = MODE_PATTERNS; break;
+			case 'l': mode = MODE_LATENCY; break;
+			case 'M': mode = MODE_MEMSPACES; break;
+			case 'r': mode = MODE_READWRITE; break;
+			case 'o': mode = MODE_OUTOFCORE; break;
+			case 'a': mode = MODE_ALLOC; break;
+			case 'n': mode = MODE_NATIVE; break;
+			case 'L': mode = MODE_LAUNCH; break;
+			case 'A': mode = MODE_ALIGNMENT; break;
+			case 'f': mode = MODE_FISSION; break;
+			case 'D': mode = MODE_MONITOR; break;
+			case 'd': deviceChoice = optarg; break;
+			case 'q':
+				mode = MODE_CONCURRENT;
+				nQueues = atoi(optarg);
+				if (nQueues < 1 || nQueues > MAXQUEUES) {
+					printf("Number of queues must be from 1 to %d\n", MAXQUEUES);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'm': mode = MODE_MULTIDEVICE; devices = optarg; break;
+			case 'w':
+				vecWidth = atoi(optarg);
+				if (vecWidth != 1 && vecWidth != 2 && vecWidth != 4 && vecWidth != 8 && vecWidth != 16) {
+					printf("Vector width must be 1, 2, 4, 8 or 16\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't':
+				for (typeChosen = 0; typeChosen < NTYPES; typeChosen++) {
+					if (strcmp(optarg, elementTypes[typeChosen].name) == 0) break;
+				}
+				if (typeChosen == NTYPES) {
+					printf("Unknown element type %s\n", optarg);
+					PrintUsage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				elementType = typeChosen;
+				typeChosen = 1;
+				break;
+			case OPT_CACHEDIR: programCacheDir = optarg; break;
+			case OPT_NOCACHE: useCache = 0; break;
+			case OPT_TUNINGFILE: tuningFile = optarg; break;
+			case OPT_RETUNE: retune = 1; break;
+			case OPT_WARMUP:
+				warmupTimes = atoi(optarg);
+				if (warmupTimes < 0) {
+					printf("Number of warm-up launches can't be negative\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_CITARGET:
+				ciTarget = atof(optarg)/100.0;
+				if (ciTarget <= 0.0) {
+					printf("Confidence interval target must be a positive percentage\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_TIMEBUDGET:
+				timeBudget = atof(optarg);
+				if (timeBudget <= 0.0) {
+					printf("Time budget must be a positive number of seconds\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_INTERVAL:
+				monitorInterval = atof(optarg);
+				if (monitorInterval <= 0.0) {
+					printf("Sampling interval must be a positive number of seconds\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_DUTYCYCLE:
+				monitorDutyCycle = atof(optarg)/100.0;
+				if (monitorDutyCycle <= 0.0 || monitorDutyCycle > 1.0) {
+					printf("Duty cycle must be a percentage above 0 and up to 100\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_SAMPLES:
+				monitorSamples = atol(optarg);
+				if (monitorSamples < 0) {
+					printf("Number of samples can't be negative\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_DROPTHRESHOLD:
+				monitorDropThreshold = atof(optarg)/100.0;
+				if (monitorDropThreshold <= 0.0 || monitorDropThreshold >= 1.0) {
+					printf("Drop threshold must be a percentage between 0 and 100\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_JSONFILE: monitorJsonFile = optarg; break;
+			case OPT_PROMFILE: monitorPromFile = optarg; break;
+			case 'h': PrintUsage(argv[0]); return EXIT_SUCCESS;
+			default:  PrintUsage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+
+	// Disable caching of binaries by nvidia implementation. We keep our own cache, and this way a source
+	// build really is one.
+	setenv("CUDA_CACHE_DISABLE", "1", 1);
+
+	// Compiled programs are cached, and tuned work-group sizes kept, in $XDG_CACHE_HOME/opencl-stream or
+	// ~/.cache/opencl-stream by default. The tuning file is kept even when program caching is off.
+	if (programCacheDir == NULL) {
+		if (getenv("XDG_CACHE_HOME") != NULL) {
+			snprintf(defaultCacheDir, sizeof(defaultCacheDir), "%s/opencl-stream", getenv("XDG_CACHE_HOME"));
+		}
+		else {
+			snprintf(defaultCacheDir, sizeof(defaultCacheDir), "%s/.cache/opencl-stream", getenv("HOME") ? getenv("HOME") : ".");
+		}
+		programCacheDir = defaultCacheDir;
+	}
+	if (MakeDirectory(programCacheDir) == EXIT_FAILURE) {
+		printf("Can't create cache directory %s, caching disabled\n", programCacheDir);
+		programCacheDir = NULL;
+	}
+	if (tuningFile == NULL && programCacheDir != NULL) {
+		snprintf(defaultTuningFile, sizeof(defaultTuningFile), "%s/tuning.txt", programCacheDir);
+		tuningFile = defaultTuningFile;
+	}
+	if (!useCache) {
+		programCacheDir = NULL;
+	}
+
+	// With --retune the saved local sizes are ignored, and the new ones override them in the file
+	if (!retune) {
+		LoadTuningFile();
+	}
+
+	// The multi-device test sets up each of its devices itself
+	if (mode == MODE_MULTIDEVICE) {
+		return RunMultiDeviceTest(devices, vecWidth);
+	}
+
+	// Set up OpenCL environment
+	cl_platform_id    *platform;
+	cl_device_id      **device_id;
+	cl_device_id      device;
+	cl_context        context;
+	cl_command_queue  queue;
+	cl_ulong          maxAlloc, globalMemSize;
+	cl_program        programs[NVECWIDTHS];
+	cl_kernel         initialiseArraysKernel;
+	cl_kernel         streamKernels[NSTREAMKERNELS][NVECWIDTHS];
+	cl_int            err;
+	cl_mem            device_A, device_B, device_C;
+	int               status = EXIT_SUCCESS;
+
+	// Without any OpenCL platform, the native baseline runs on its own at the default array size, with the
+	// scalar of the OpenCL kernels
+	cl_uint numPlatforms = 0;
+	if (mode == MODE_NATIVE && (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS || numPlatforms == 0)) {
+		printf("No OpenCL platform found, running the native baseline only\n");
+		return RunNativeTest(NULL, NULL, 3.0, (size_t)(TRYARRAYBYTES/elementTypes[elementType].size)/16*16, vecWidth);
+	}
+
+	// The monitoring mode runs unattended, so it never asks for a device
+	if (mode == MODE_MONITOR && deviceChoice == NULL) {
+		deviceChoice = "0:0";
+	}
+	if (InitialiseCLEnvironment(&platform, &device_id, &device, &context, &queue, &maxAlloc, &globalMemSize,
+	                            deviceChoice) == EXIT_FAILURE) {
+		printf("Error initialising OpenCL environment\n");
+		return EXIT_FAILURE;
+	}
+
+	// Check the device supports the element type. If double wasn't asked for explicitly, fall back to float.
+	if (elementTypes[elementType].extension != NULL && !DeviceHasExtension(&device, elementTypes[elementType].extension)) {
+		if (typeChosen) {
+			printf("Device does not support %s (%s)\n", elementTypes[elementType].name, elementTypes[elementType].extension);
+			return EXIT_FAILURE;
+		}
+		printf("Device does not support double precision, using float.\n");
+		elementType = TYPE_FLOAT;
+	}
+	const size_t elementSize = elementTypes[elementType].size;
+	printf("Element type: %s\n", elementTypes[elementType].name);
+
+	// The fission test sets up each sub-device itself, like the multi-device test
+	if (mode == MODE_FISSION) {
+		status = RunFissionTest(&device, vecWidth);
+		CleanUpCLEnvironment(&platform, &device_id, &context, &queue);
+		free(tuningEntries);
+		return status;
+	}
+
+	// Build the kernels for each vector size (scalar(1), 2, 4, 8, 16), and create the stream
+	// functions copy, scale, add, triad from each.
+	for (int v = 0; v < NVECWIDTHS; v++) {
+		if (BuildProgram(&context, &device, vecWidths[v], &programs[v]) == EXIT_FAILURE) {
+			printf("Error building OpenCL program\n");
+			return EXIT_FAILURE;
+		}
+	}
+	initialiseArraysKernel = clCreateKernel(programs[0], "initialiseArraysKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			char kernelName[64];
+			snprintf(kernelName, sizeof(kernelName), "%sKernel", streamKernelInfo[k].name);
+			streamKernels[k][v] = clCreateKernel(programs[v], kernelName, &err);
+			CheckOpenCLError(err, __LINE__);
+		}
+	}
+
+	// Allocate device memory. The sweep and latency test go up to the largest arrays the device allows. The
+	// allocation test leaves room for a second set of arrays beside these, and the monitoring mode for its list.
+	size_t arraySize = GetArraySize(mode == MODE_SWEEP || mode == MODE_LATENCY ? maxAlloc : TRYARRAYBYTES, maxAlloc,
+	                                mode == MODE_ALLOC ? globalMemSize/2 :
+	                                mode == MODE_MONITOR ? globalMemSize/4*3 : globalMemSize);
+	size_t sizeBytes = arraySize*elementSize;
+	device_A = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
+	device_B = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
+	device_C = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
+	CheckOpenCLError(err, __LINE__);
+
+	// Set kernel arguemnts. Scale and Triad kernels involve multiplication by a scalar:
+	const double scalar = 3.0;
+
+	err  = clSetKernelArg(initialiseArraysKernel, 0, sizeof(cl_mem), &device_A);
+	err |= clSetKernelArg(initialiseArraysKernel, 1, sizeof(cl_mem), &device_B);
+	err |= clSetKernelArg(initialiseArraysKernel, 2, sizeof(cl_mem), &device_C);
+	CheckOpenCLError(err, __LINE__);
+	SetStreamKernelArgs(streamKernels, &device_A, &device_B, &device_C, scalar);
+
+
+	// Initialize arrays
+	size_t initGlobalSize = arraySize;
+	err = clEnqueueNDRangeKernel(queue, initialiseArraysKernel, 1, NULL, &initGlobalSize, NULL, 0, NULL, NULL);
+	clFinish(queue);
+
+
+	if (mode == MODE_SWEEP) {
+		// Each step runs on a different sized prefix of the arrays, so the final values can't be verified.
+		RunSweep(&queue, streamKernels, &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else if (mode == MODE_TRANSFER) {
+		// The arrays are overwritten by the transfers, so there is nothing to verify
+		status = RunTransferTest(&context, &queue, &device_A, &device_B, sizeBytes);
+	}
+	else if (mode == MODE_PATTERNS) {
+		// The strided triad and scatter leave parts of the arrays changed, so there is nothing to verify
+		RunPatternTest(&device, &context, &queue, &programs[0], &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else if (mode == MODE_LATENCY) {
+		// The list overwrites array A, so there is nothing to verify
+		RunLatencyTest(&queue, &programs[0], &device_A, &device_B, sizeBytes);
+	}
+	else if (mode == MODE_MEMSPACES) {
+		// The local memory and image kernels write their results over array A, so there is nothing to verify
+		RunMemorySpaceTest(&device, &context, &queue, &programs[0], streamKernels, &device_A, &device_B, &device_C,
+		                   scalar, arraySize);
+	}
+	else if (mode == MODE_READWRITE) {
+		// The ratio kernels write over parts of array C, so there is nothing to verify
+		int v = 0;
+		while (vecWidths[v] != vecWidth) v++;
+		RunReadWriteTest(&queue, &programs[v], &device_A, &device_C, scalar, arraySize, vecWidth);
+	}
+	else if (mode == MODE_OUTOFCORE) {
+		// The device arrays only hold chunks in flight, the host arrays are checked by the test itself
+		int v = 0;
+		while (vecWidths[v] != vecWidth) v++;
+		status = RunOutOfCoreTest(&device, &context, &programs[v], &device_A, &device_B, &device_C, scalar, sizeBytes,
+		                          globalMemSize, vecWidth);
+	}
+	else if (mode == MODE_LAUNCH) {
+		// The crossover sweep runs triad on prefixes of the arrays, so there is nothing to verify
+		RunLaunchTest(&device, &context, programs, &device_A, &device_B, &device_C, scalar, arraySize, vecWidth);
+	}
+	else if (mode == MODE_ALIGNMENT) {
+		// Each offset runs copy and triad on a shifted part of the arrays, so there is nothing to verify
+		RunAlignmentTest(&device, &queue, programs, &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else if (mode == MODE_MONITOR) {
+		// Triad runs for as long as the monitor does, so there is nothing to verify
+		status = RunMonitor(&device, &context, &queue, programs, streamKernels, arraySize, vecWidth);
+	}
+	else if (mode == MODE_ALLOC) {
+		// Each flavour's arrays are verified by the test itself
+		status = RunAllocationTest(&device, &context, &queue, programs, scalar, arraySize, vecWidth);
+	}
+	else if (mode == MODE_NATIVE) {
+		// The native arrays are checked by the test itself, the device arrays as usual
+		status = RunNativeTest(&queue, streamKernels, scalar, arraySize, vecWidth);
+		if (VerifyResults(&context, &programs[0], &queue, &device_A, &device_B, &device_C, scalar, arraySize) != EXIT_SUCCESS) {
+			status = EXIT_FAILURE;
+		}
+	}
+	else if (mode == MODE_CONCURRENT) {
+		// Each queue runs the kernels on its own part of the arrays, so the final values can be checked
+		int v = 0;
+		while (vecWidths[v] != vecWidth) v++;
+		RunConcurrentTest(&device, &context, &programs[v], &device_A, &device_B, &device_C, scalar, arraySize, vecWidth, nQueues);
+		status = VerifyResults(&context, &programs[0], &queue, &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else if (mode == MODE_VALIDATE) {
+		status = RunValidation(&context, programs, &queue, &initialiseArraysKernel, streamKernels,
+		                       &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else if (mode == MODE_GRIDSTRIDE) {
+		RunGridStrideTest(&device, &queue, programs, streamKernels, &device_A, &device_B, &device_C, scalar, arraySize);
+
+		// Grid-stride and one item kernels compute the same values, so the final arrays can be checked
+		status = VerifyResults(&context, &programs[0], &queue, &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+	else {
+		// Times are per kernel launch, measured on the device. The last two columns are the launch overhead
+		// in microseconds: time from being enqueued to being submitted to the device, and from being submitted
+		// to starting execution. Work-group sizes found by an earlier run are taken from the tuning file.
+		// The launches at the best work-group size repeat adaptively, and their statistics follow.
+		TestResult results[NSTREAMKERNELS][NVECWIDTHS];
+		int nTuned = 0;
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("Function        Best Rate GB/s   Avg time   Min time   Max time   Best Workgroup Size   Best GFLOPS   Queue->Submit   Submit->Start\n");
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+			for (int v = 0; v < NVECWIDTHS; v++) {
+				char testName[64], tuningKey[1024];
+				TestResult *result = &results[k][v];
+				size_t localSize;
+				snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidths[v]);
+				GetTuningKey(&device, testName, arraySize, tuningKey, sizeof(tuningKey));
+				if (LookupTuning(tuningKey, &localSize) && localSize <= arraySize/vecWidths[v]) {
+					TimeLocalSize(&queue, &streamKernels[k][v], vecWidths[v], arraySize, localSize, NTIMES, 1, result);
+					nTuned++;
+				}
+				else {
+					RunTest(&queue, &streamKernels[k][v], vecWidths[v], arraySize, 1, result);
+					SaveTuning(tuningKey, result->bestLocalSize);
+				}
+				PrintResult(testName, streamKernelInfo[k].memops, streamKernelInfo[k].flops, result);
+			}
+		}
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		if (nTuned > 0) {
+			printf("%d of %d work-group sizes from tuning file %s, use --retune to search again\n",
+			       nTuned, NSTREAMKERNELS*NVECWIDTHS, tuningFile);
+		}
+
+		printf("\nLaunch statistics after %d warm-up launches, repeated until the median is known to within %.2lf%% or for %.1lf s\n",
+		       warmupTimes, ciTarget*100.0, timeBudget);
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("Function        Launches   Median Rate GB/s   Median time    P5 time   P95 time    Std dev   Median CI +-%%   Outliers\n");
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+			for (int v = 0; v < NVECWIDTHS; v++) {
+				char testName[64];
+				snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidths[v]);
+				PrintStatistics(testName, streamKernelInfo[k].memops, &results[k][v]);
+			}
+		}
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+		// Check results are correct
+		status = VerifyResults(&context, &programs[0], &queue, &device_A, &device_B, &device_C, scalar, arraySize);
+	}
+
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			clReleaseKernel(streamKernels[k][v]);
+		}
+	}
+	clReleaseKernel(initialiseArraysKernel);
+	for (int v = 0; v < NVECWIDTHS; v++) {
+		clReleaseProgram(programs[v]);
+	}
+	clReleaseMemObject(device_A);
+	clReleaseMemObject(device_B);
+	clReleaseMemObject(device_C);
+	CleanUpCLEnvironment(&platform, &device_id, &context, &queue);
+	free(tuningEntries);
+	return status;
+}
+
+
+
+void PrintUsage(char *programName)
+{
+	printf("Usage: %s [options]\n", programName);
+	printf("  -s, --sweep        Sweep the array size from %d KB up to the device maximum\n", SWEEPMINSIZE/1024);
+	printf("  -g, --gridstride   Compare grid-stride kernels over occupancy and unroll factor with the one item per\n");
+	printf("                     work-item kernels\n");
+	printf("  -x, --transfer     Measure host<->device transfer bandwidth and time per transfer for each transfer\n");
+	printf("                     method, from %d KB up to the array size\n", TRANSFERMINSIZE/1024);
+	printf("  -V, --validate     Interleave copy, scale, add and triad like STREAM for each vector width, and check\n");
+	printf("                     every array against the expected values on the device\n");
+	printf("  -p, --patterns     Measure strided copy and triad, and gather and scatter with sequential, blocked\n");
+	printf("                     shuffle and random indices\n");
+	printf("  -l, --latency      Measure memory latency by pointer chasing, from %d KB up to the device maximum, with\n", CHASEMINBYTES/1024);
+	printf("                     1 up to %d concurrent chains\n", CHASEMAXCHAINS);
+	printf("  -M, --memspaces    Measure local memory (with bank conflicting strides), constant memory and image\n");
+	printf("                     bandwidth next to global memory\n");
+	printf("  -r, --readwrite    Measure read-only, write-only and 1:1 up to %d:%d read:write ratio bandwidth, with\n", MAXRATIO, MAXRATIO);
+	printf("                     non-temporal stores where the compiler supports them\n");
+	printf("  -o, --outofcore    Stream host arrays larger than device memory through the device in chunks, with the\n");
+	printf("                     uploads, triad and downloads of different chunks overlapped on up to %d queues\n", OOCMAXBUFFERS);
+	printf("  -L, --launch       Measure empty kernel launch throughput, launch to completion latency with clFinish,\n");
+	printf("                     clWaitForEvents and event callbacks, and the triad array size where bandwidth\n");
+	printf("                     takes over from launch overhead, on in-order and out-of-order queues\n");
+	printf("  -A, --alignment    Measure copy and triad at each vector width on sub-buffers of the arrays offset by\n");
+	printf("                     0 up to %d cache lines, one item at a time\n", ALIGNCACHELINES);
+	printf("  -f, --fission      Partition the device into sub-devices, and run the kernels on sub-devices of 1, 2, 4,\n");
+	printf("                     ... compute units, and on each NUMA domain (or other affinity domain) and half of the\n");
+	printf("                     device alone and all at once\n");
+	printf("  -D, --monitor      Keep running, and sample triad bandwidth and memory latency at a low duty cycle. Each\n");
+	printf("                     sample is appended to a JSON lines file and written to a Prometheus text file, and\n");
+	printf("                     sustained drops below a rolling baseline are reported. Stop with SIGINT or SIGTERM.\n");
+	printf("  -a, --alloc        Run copy, scale, add and triad on device buffers, ALLOC_HOST_PTR and USE_HOST_PTR\n");
+	printf("                     buffers, and coarse and fine-grained SVM, as far as the device supports them\n");
+	printf("  -n, --native       Run copy, scale, add and triad natively on the host, on a pinned thread per CPU with\n");
+	printf("                     AVX2, AVX-512 and generic code, next to the OpenCL kernels. Runs without a device.\n");
+	printf("  -q, --queues N     Run the kernels concurrently on 1 up to N command queues, each on its own part of the\n");
+	printf("                     arrays, and report per-queue and aggregate bandwidth\n");
+	printf("  -m, --multidevice LIST\n");
+	printf("                     Run the kernels concurrently on several devices, one host thread each. LIST is\n");
+	printf("                     \"all\" or platform:device indices separated by commas, eg. 0:0,1:0\n");
+	printf("  -w, --vecwidth W   Vector width of the kernels for --readwrite, --outofcore, --launch, --alloc, --native,\n");
+	printf("                     --fission, --monitor, --queues and --multidevice (default 4)\n");
+	printf("  -t, --type TYPE    Element type of the arrays: double (default), float, half, int or long\n");
+	printf("  -d, --device P:D   Use device D of platform P instead of asking (--monitor uses 0:0 by default)\n");
+	printf("  --cache-dir DIR    Directory of the compiled program cache (default $XDG_CACHE_HOME/opencl-stream or\n");
+	printf("                     ~/.cache/opencl-stream)\n");
+	printf("  --no-cache         Always build the kernels from source\n");
+	printf("  --tuning-file FILE File of the best work-group sizes found by the autotuner (default tuning.txt in the\n");
+	printf("                     cache directory)\n");
+	printf("  --retune           Search the work-group sizes again instead of using the tuning file\n");
+	printf("  --warmup N         Untimed launches before each timed batch (default %d)\n", WARMUPTIMES);
+	printf("  --ci-target PCT    Repeat the final timings until the median is known to within PCT percent at 95%%\n");
+	printf("                     confidence (default %.1lf)\n", CITARGET*100.0);
+	printf("  --time-budget S    Stop repeating a timing after S seconds even if the target isn't met (default %.1lf)\n", TIMEBUDGET);
+	printf("  --interval S       Seconds between --monitor samples (default %.0lf)\n", MONITORINTERVAL);
+	printf("  --duty-cycle PCT   Most of the time --monitor spends sampling, in percent; samples that take longer space\n");
+	printf("                     out the interval (default %.1lf)\n", MONITORDUTYCYCLE*100.0);
+	printf("  --samples N        Stop --monitor after N samples (default 0, run until stopped)\n");
+	printf("  --drop-threshold PCT\n");
+	printf("                     How far below the baseline --monitor samples count as a drop (default %.0lf)\n",
+	       MONITORDROP*100.0);
+	printf("  --json-file FILE   JSON lines file --monitor appends samples to (default %s)\n", MONITORJSONFILE);
+	printf("  --prom-file FILE   Prometheus text file --monitor rewrites after each sample (default %s)\n", MONITORPROMFILE);
+	printf("  -h, --help         Show this message\n");
+}
+
+
+
+void SetStreamKernelArgs(cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar)
+{
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			SetStreamKernelArg(&streamKernels[k][v], k, device_A, device_B, device_C, scalar);
+		}
+	}
+}
+
+
+
+// Set the arguments of one of the stream kernels, of any variant. Returns the number of arguments set, so
+// that callers can add their own after them.
+cl_uint SetStreamKernelArg(cl_kernel *kernel, int k, cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar)
+{
+	cl_int err = CL_SUCCESS;
+	cl_uint nArgs = 0;
+
+	switch (k) {
+		case COPY:
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_A);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_C);
+			break;
+		case SCALE:
+			err |= SetScalarKernelArg(kernel, nArgs++, scalar);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_B);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_C);
+			break;
+		case ADD:
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_A);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_B);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_C);
+			break;
+		case TRIAD:
+			err |= SetScalarKernelArg(kernel, nArgs++, scalar);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_A);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_B);
+			err |= clSetKernelArg(*kernel, nArgs++, sizeof(cl_mem), device_C);
+			break;
+	}
+	CheckOpenCLError(err, __LINE__);
+	return nArgs;
+}
+
+
+
+#ifdef CL_VERSION_2_0
+// As SetStreamKernelArg, with the arrays in shared virtual memory
+cl_uint SetStreamKernelArgSVM(cl_kernel *kernel, int k, void *A, void *B, void *C, double scalar)
+{
+	cl_int err = CL_SUCCESS;
+	cl_uint nArgs = 0;
+
+	switch (k) {
+		case COPY:
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, A);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, C);
+			break;
+		case SCALE:
+			err |= SetScalarKernelArg(kernel, nArgs++, scalar);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, B);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, C);
+			break;
+		case ADD:
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, A);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, B);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, C);
+			break;
+		case TRIAD:
+			err |= SetScalarKernelArg(kernel, nArgs++, scalar);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, A);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, B);
+			err |= clSetKernelArgSVMPointer(*kernel, nArgs++, C);
+			break;
+	}
+	CheckOpenCLError(err, __LINE__);
+	return nArgs;
+}
+#endif
+
+
+
+// Find the best local size of a kernel. A few launches of each candidate drop the clearly losing ones, then the
+// fastest few are timed in full, NTIMES launches each, repeated adaptively for the STREAM table. Local sizes
+// that don't divide the number of work-items still cover the array, with a last partial work-group of idle
+// work-items, so the candidates are compared on the same work.
+void RunTest(cl_command_queue * queue, cl_kernel * kernel, size_t vecWidth, size_t arraySize, int adaptive, TestResult *result)
+{
+	size_t candidates[MAXTUNECANDIDATES];
+	double probeTime[MAXTUNECANDIDATES];
+	int nCandidates = GetLocalSizeCandidates(queue, kernel, arraySize/vecWidth, candidates);
+	double bestProbeTime = DBL_MAX;
+
+	for (int c = 0; c < nCandidates; c++) {
+		TestResult probe;
+		TimeLocalSize(queue, kernel, vecWidth, arraySize, candidates[c], TUNEPROBETIMES, 0, &probe);
+		probeTime[c] = probe.avgTime/probe.items;
+		if (probeTime[c] < bestProbeTime) bestProbeTime = probeTime[c];
+	}
+
+	// Time the fastest candidates within TUNEPRUNEFACTOR of the best, fastest first
+	double bestAvgTime = DBL_MAX;
+	for (int f = 0; f < TUNEMAXFINALISTS; f++) {
+		int next = -1;
+		for (int c = 0; c < nCandidates; c++) {
+			if (probeTime[c] <= bestProbeTime*TUNEPRUNEFACTOR && (next == -1 || probeTime[c] < probeTime[next])) next = c;
+		}
+		if (next == -1) break;
+		probeTime[next] = DBL_MAX;
+
+		TestResult lsResult;
+		TimeLocalSize(queue, kernel, vecWidth, arraySize, candidates[next], NTIMES, adaptive, &lsResult);
+		if (lsResult.avgTime/lsResult.items < bestAvgTime) {
+			bestAvgTime = lsResult.avgTime/lsResult.items;
+			*result = lsResult;
+		}
+
+#ifdef VERBOSE
+		printf("------------- localSize = %4zu, avg time = %8.6lf s\n", candidates[next], lsResult.avgTime);
+#endif
+
+	}
+}
+
+
+
+// Local sizes to try for a kernel: 0 for the runtime's choice (a NULL local size), then multiples of the
+// preferred work-group size multiple, up to the smaller of the device and kernel limits
+int GetLocalSizeCandidates(cl_command_queue *queue, cl_kernel *kernel, size_t globalSize, size_t *candidates)
+{
+	cl_device_id device;
+	size_t deviceMax, kernelMax, preferred;
+
+	clGetCommandQueueInfo(*queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(deviceMax), &deviceMax, NULL);
+	clGetKernelWorkGroupInfo(*kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernelMax), &kernelMax, NULL);
+	clGetKernelWorkGroupInfo(*kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(preferred), &preferred, NULL);
+
+	size_t maxLocalSize = kernelMax < deviceMax ? kernelMax : deviceMax;
+	if (maxLocalSize > globalSize) maxLocalSize = globalSize;
+	if (preferred > maxLocalSize) preferred = maxLocalSize;
+	if (preferred == 0) preferred = 1;
+
+	int nCandidates = 0;
+	candidates[nCandidates++] = 0;
+	size_t m = 1;
+	while (m*preferred <= maxLocalSize && nCandidates < MAXTUNECANDIDATES - 1) {
+		candidates[nCandidates++] = m*preferred;
+		m = m < TUNEMAXMULTIPLES ? m + 1 : (size_t)(m*1.4142135623731);
+	}
+	// The largest allowed size, if it isn't a multiple that was already reached
+	if (candidates[nCandidates-1] != maxLocalSize) candidates[nCandidates++] = maxLocalSize;
+
+	return nCandidates;
+}
+
+
+
+// Time a kernel at one local size, 0 for the runtime's choice. The global size is rounded up to whole
+// work-groups, and the kernel's last argument tells the extra work-items to do nothing, so every launch covers
+// all arraySize items whether or not the local size divides the number of work-items.
+void TimeLocalSize(cl_command_queue *queue, cl_kernel *kernel, size_t vecWidth, size_t arraySize, size_t localSize, int nTimes,
+                   int adaptive, TestResult *result)
+{
+	const size_t nWorkItems = arraySize/vecWidth;
+	size_t globalSize = nWorkItems;
+	if (localSize != 0) globalSize = (nWorkItems + localSize - 1)/localSize*localSize;
+
+	cl_int err = SetItemCountArg(kernel, nWorkItems);
+	CheckOpenCLError(err, __LINE__);
+	TimeKernel(queue, kernel, globalSize, localSize, nTimes, adaptive, result);
+	result->items = nWorkItems*vecWidth;
+}
+
+
+
+// Set the number of work-items that do work, the last argument of every kernel that TimeLocalSize times.
+// Launches of those kernels elsewhere set it too.
+cl_int SetItemCountArg(cl_kernel *kernel, size_t nWorkItems)
+{
+	cl_uint nArgs;
+	cl_ulong n = nWorkItems;
+	cl_int err = clGetKernelInfo(*kernel, CL_KERNEL_NUM_ARGS, sizeof(nArgs), &nArgs, NULL);
+	if (err != CL_SUCCESS) return err;
+	return clSetKernelArg(*kernel, nArgs - 1, sizeof(cl_ulong), &n);
+}
+
+
+
+// Launch a kernel nTimes and time each launch on the device, so host enqueue cost is not included. warmupTimes
+// untimed launches go first, so that lazy allocation and first touch of the buffers aren't counted. If adaptive,
+// batches of nTimes launches repeat until the median is known to within ciTarget, the time budget is spent, or
+// MAXTIMES launches are timed. Launches later in a batch wait behind their predecessors between submit
+// and start, so the minimum gaps are kept as the launch overhead. A localSize of 0 leaves the work-group size to
+// the runtime.
+void TimeKernel(cl_command_queue *queue, cl_kernel *kernel, size_t globalSize, size_t localSize, int nTimes, int adaptive,
+                TestResult *result)
+{
+	const int maxTimes = adaptive ? MAXTIMES : nTimes;
+	cl_event *events = malloc(nTimes*sizeof(cl_event));
+	double *times = malloc(maxTimes*sizeof(double));
+	const size_t *local = localSize ? &localSize : NULL;
+	const double startTime = GetWallTime();
+	int err = CL_SUCCESS;
+
+	for (int n = 0; n < warmupTimes; n++) {
+		err |= clEnqueueNDRangeKernel(*queue, *kernel, 1, NULL, &globalSize, local, 0, NULL, NULL);
+	}
+
+	result->bestLocalSize = localSize;
+	result->queuedToSubmit = DBL_MAX;
+	result->submitToStart = DBL_MAX;
+	int nTimed = 0;
+	do {
+		int nBatch = maxTimes - nTimed < nTimes ? maxTimes - nTimed : nTimes;
+		for (int n = 0; n < nBatch; n++) {
+			err |= clEnqueueNDRangeKernel(*queue, *kernel, 1, NULL, &globalSize, local, 0, NULL, &events[n]);
+		}
+		clFinish(*queue);
+		CheckOpenCLError(err, __LINE__);
+
+		for (int n = 0; n < nBatch; n++) {
+			times[nTimed++] = GetEventTime(events[n], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+
+			double gap = GetEventTime(events[n], CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT);
+			if (gap < result->queuedToSubmit) result->queuedToSubmit = gap;
+			gap = GetEventTime(events[n], CL_PROFILING_COMMAND_SUBMIT, CL_PROFILING_COMMAND_START);
+			if (gap < result->submitToStart) result->submitToStart = gap;
+
+			clReleaseEvent(events[n]);
+		}
+		GetTimeStatistics(times, nTimed, result);
+	} while (adaptive && nTimed < maxTimes && result->medianCI > ciTarget && GetWallTime() - startTime < timeBudget);
+
+	free(events);
+	free(times);
+}
+
+
+
+// Statistics of nTimes launch times, which are sorted in place. The median's confidence interval is the
+// distribution-free one between the order statistics n/2 -+ 1.96*sqrt(n)/2.
+void GetTimeStatistics(double *times, int nTimes, TestResult *result)
+{
+	qsort(times, nTimes, sizeof(double), CompareDoubles);
+
+	double totalTime = 0.0;
+	for (int n = 0; n < nTimes; n++) {
+		totalTime += times[n];
+	}
+	double sumSquares = 0.0;
+	result->avgTime = totalTime/nTimes;
+	for (int n = 0; n < nTimes; n++) {
+		sumSquares += (times[n] - result->avgTime)*(times[n] - result->avgTime);
+	}
+	result->stdDevTime = nTimes > 1 ? sqrt(sumSquares/(nTimes - 1)) : 0.0;
+
+	// Percentiles by nearest rank
+	#define PERCENTILE(p) times[(int)ceil((p)*nTimes) > 0 ? (int)ceil((p)*nTimes) - 1 : 0]
+	result->nTimes = nTimes;
+	result->minTime = times[0];
+	result->maxTime = times[nTimes-1];
+	result->medianTime = nTimes % 2 ? times[nTimes/2] : 0.5*(times[nTimes/2 - 1] + times[nTimes/2]);
+	result->p5Time = PERCENTILE(0.05);
+	result->p95Time = PERCENTILE(0.95);
+
+	double spread = 1.96*sqrt(nTimes)/2.0;
+	int lower = (int)floor(nTimes/2.0 - spread);
+	int upper = (int)ceil(nTimes/2.0 + spread);
+	if (lower < 0) lower = 0;
+	if (upper > nTimes - 1) upper = nTimes - 1;
+	result->medianCI = 0.5*(times[upper] - times[lower])/result->medianTime;
+
+	double q1 = PERCENTILE(0.25), q3 = PERCENTILE(0.75);
+	#undef PERCENTILE
+	result->nOutliers = 0;
+	for (int n = 0; n < nTimes; n++) {
+		if (times[n] < q1 - 1.5*(q3 - q1) || times[n] > q3 + 1.5*(q3 - q1)) result->nOutliers++;
+	}
+}
+
+
+
+int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+
+
+// memops is the number of memory operations per output array item. Used in bandwidth calculation.
+// flops is the number of flops per output array item. Used in flops calculation.
+void PrintResult(char *testName, int memops, int flops, TestResult *result)
+{
+	char localSize[32];
+	FormatLocalSize(result->bestLocalSize, localSize, sizeof(localSize));
+
+	printf("%13s   %14.3lf   %8.6lf   %8.6lf   %8.6lf   %19s   %11.3lf   %13.2lf   %13.2lf\n",
+	       testName, memops*result->items*elementTypes[elementType].size/1024.0/1024.0/1024.0/result->minTime, result->avgTime,
+	       result->minTime, result->maxTime, localSize, flops*result->items/1.0e9/result->minTime,
+	       result->queuedToSubmit*1.0e6, result->submitToStart*1.0e6);
+}
+
+
+
+// Launch count and distribution of the launch times of one kernel, with the bandwidth at the median time
+void PrintStatistics(char *testName, int memops, TestResult *result)
+{
+	printf("%13s   %8d   %16.3lf   %11.6lf   %8.6lf   %8.6lf   %8.6lf   %12.2lf%%   %8d\n",
+	       testName, result->nTimes, memops*result->items*elementTypes[elementType].size/1024.0/1024.0/1024.0/result->medianTime,
+	       result->medianTime, result->p5Time, result->p95Time, result->stdDevTime, result->medianCI*100.0, result->nOutliers);
+}
+
+
+
+// Local size for printing: 0 is the runtime's choice
+void FormatLocalSize(size_t localSize, char *string, size_t length)
+{
+	if (localSize == 0) snprintf(string, length, "runtime");
+	else snprintf(string, length, "%zu", localSize);
+}
+
+
+
+// Run every kernel over a geometric range of array sizes, to find where the device's caches give way to
+// main memory. The full size buffers are reused through sub-buffers at offset zero, so nothing is reallocated.
+void RunSweep(cl_command_queue *queue, cl_kernel streamKernels[][NVECWIDTHS],
+              cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t maxArraySize)
+{
+	// Two steps per doubling. Sizes are kept a multiple of the largest vector width.
+	const size_t elementSize = elementTypes[elementType].size;
+	size_t nSizes = 0;
+	size_t sizes[SWEEPMAXSTEPS];
+	for (double bytes = SWEEPMINSIZE; bytes <= maxArraySize*elementSize && nSizes < SWEEPMAXSTEPS; bytes *= 1.4142135623731) {
+		size_t arraySize = ((size_t)bytes/elementSize/16)*16;
+		if (nSizes == 0 || arraySize != sizes[nSizes-1]) sizes[nSizes++] = arraySize;
+	}
+
+	double *bandwidth = malloc(nSizes*NSTREAMKERNELS*NVECWIDTHS*sizeof(double));
+	cl_int err;
+
+	for (size_t i = 0; i < nSizes; i++) {
+		cl_buffer_region region = {0, sizes[i]*elementSize};
+		cl_mem sub_A = clCreateSubBuffer(*device_A, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		cl_mem sub_B = clCreateSubBuffer(*device_B, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		cl_mem sub_C = clCreateSubBuffer(*device_C, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		CheckOpenCLError(err, __LINE__);
+		SetStreamKernelArgs(streamKernels, &sub_A, &sub_B, &sub_C, scalar);
+
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			for (int v = 0; v < NVECWIDTHS; v++) {
+				TestResult result;
+				RunTest(queue, &streamKernels[k][v], vecWidths[v], sizes[i], 0, &result);
+				bandwidth[(i*NSTREAMKERNELS + k)*NVECWIDTHS + v] =
+					streamKernelInfo[k].memops*result.items*elementSize/1024.0/1024.0/1024.0/result.minTime;
+			}
+		}
+
+		clReleaseMemObject(sub_A);
+		clReleaseMemObject(sub_B);
+		clReleaseMemObject(sub_C);
+	}
+	// Leave the kernels pointing at the full arrays
+	SetStreamKernelArgs(streamKernels, device_A, device_B, device_C, scalar);
+
+	// Best rate in GB/s of each vector width, against the size of one array and the total footprint of the kernel
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("%-11s   Array size KB   Footprint KB", streamKernelInfo[k].name);
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			char typeName[16];
+			snprintf(typeName, sizeof(typeName), "%s%zu", elementTypes[elementType].name, vecWidths[v]);
+			printf("   %9s", vecWidths[v] == 1 ? elementTypes[elementType].name : typeName);
+		}
+		printf("\n-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (size_t i = 0; i < nSizes; i++) {
+			printf("%-11s   %13.1lf   %12.1lf", "", sizes[i]*elementSize/1024.0,
+			       streamKernelInfo[k].memops*sizes[i]*elementSize/1024.0);
+			for (int v = 0; v < NVECWIDTHS; v++) {
+				printf("   %9.3lf", bandwidth[(i*NSTREAMKERNELS + k)*NVECWIDTHS + v]);
+			}
+			printf("\n");
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	free(bandwidth);
+}
+
+
+
+// Compare grid-stride kernels, where a fixed number of work-items loops over the arrays, with the one item per
+// work-item kernels. The grid is a number of work-groups per compute unit, and the kernels are compiled with
+// each unroll factor. The best configuration is reported for each kernel and vector width.
+void RunGridStrideTest(cl_device_id *device, cl_command_queue *queue, cl_program programs[], cl_kernel streamKernels[][NVECWIDTHS],
+                       cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize)
+{
+	cl_uint computeUnits;
+	cl_int err;
+
+	clGetDeviceInfo(*device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+	printf("Device has %u compute units\n", computeUnits);
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function          Best Rate GB/s   Workgroup Size   Workgroups/CU   Unroll   One-item GB/s   Speedup\n");
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			cl_ulong n = arraySize/vecWidths[v];
+			double bestTime = DBL_MAX;
+			size_t bestLocalSize = 0, bestOccupancy = 0;
+			int bestUnroll = 0;
+
+			for (int u = 0; u < NUNROLLS; u++) {
+				char kernelName[64];
+				snprintf(kernelName, sizeof(kernelName), "%sGridKernel_%d", streamKernelInfo[k].name, unrolls[u]);
+				cl_kernel kernel = clCreateKernel(programs[v], kernelName, &err);
+				CheckOpenCLError(err, __LINE__);
+				cl_uint nArgs = SetStreamKernelArg(&kernel, k, device_A, device_B, device_C, scalar);
+				err = clSetKernelArg(kernel, nArgs, sizeof(cl_ulong), &n);
+				CheckOpenCLError(err, __LINE__);
+
+				size_t localSize = GRIDLOCALSIZE;
+				size_t maxLocalSize;
+				clGetKernelWorkGroupInfo(kernel, *device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, NULL);
+				if (localSize > maxLocalSize) localSize = maxLocalSize;
+
+				for (int o = 0; o < NOCCUPANCIES; o++) {
+					// No point in more work-items than array items
+					size_t globalSize = computeUnits*occupancies[o]*localSize;
+					if (globalSize > n) break;
+
+					TestResult result;
+					TimeKernel(queue, &kernel, globalSize, localSize, GRIDNTIMES, 0, &result);
+					if (result.minTime < bestTime) {
+						bestTime = result.minTime;
+						bestLocalSize = localSize;
+						bestOccupancy = occupancies[o];
+						bestUnroll = unrolls[u];
+					}
+				}
+				clReleaseKernel(kernel);
+			}
+
+			TestResult oneItem;
+			RunTest(queue, &streamKernels[k][v], vecWidths[v], arraySize, 0, &oneItem);
+
+			char testName[64];
+			double bytes = streamKernelInfo[k].memops*arraySize*elementTypes[elementType].size/1024.0/1024.0/1024.0;
+			double oneItemBytes = streamKernelInfo[k].memops*oneItem.items*elementTypes[elementType].size/1024.0/1024.0/1024.0;
+			snprintf(testName, sizeof(testName), "%sGridKernel%zu", streamKernelInfo[k].name, vecWidths[v]);
+			printf("%17s   %12.3lf   %14zu   %13zu   %6d   %13.3lf   %7.3lf\n",
+			       testName, bytes/bestTime, bestLocalSize, bestOccupancy, bestUnroll,
+			       oneItemBytes/oneItem.minTime, (bytes/bestTime)/(oneItemBytes/oneItem.minTime));
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+
+
+// Strided and indexed access patterns, with the scalar kernels. Useful bandwidth counts the bytes of the items the
+// kernel asks for, including the gather/scatter indices. Effective bandwidth counts a whole cache line for each
+// access that doesn't use the rest of its line: strides wider than a line, and the data side of random indices.
+void RunPatternTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program *program,
+                    cl_mem *device_A, cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	cl_uint lineSize;
+	cl_int err;
+
+	// The indices are 32 bit
+	if (arraySize > CL_UINT_MAX) {
+		printf("Arrays of %zu items are too large for 32 bit indices\n", arraySize);
+		return;
+	}
+
+	clGetDeviceInfo(*device, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, sizeof(lineSize), &lineSize, NULL);
+	if (lineSize == 0) lineSize = DEFAULTCACHELINE;
+	printf("Global memory cache line: %u bytes\n", lineSize);
+
+	cl_kernel copyStridedKernel = clCreateKernel(*program, "copyStridedKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel triadStridedKernel = clCreateKernel(*program, "triadStridedKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel gatherKernel = clCreateKernel(*program, "gatherKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel scatterKernel = clCreateKernel(*program, "scatterKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel indexKernel = clCreateKernel(*program, "indexKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_mem device_idx = clCreateBuffer(*context, CL_MEM_READ_WRITE, arraySize*sizeof(cl_uint), NULL, &err);
+	CheckOpenCLError(err, __LINE__);
+
+	err  = clSetKernelArg(copyStridedKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(copyStridedKernel, 1, sizeof(cl_mem), device_C);
+	err |= SetScalarKernelArg(&triadStridedKernel, 0, scalar);
+	err |= clSetKernelArg(triadStridedKernel, 1, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(triadStridedKernel, 2, sizeof(cl_mem), device_B);
+	err |= clSetKernelArg(triadStridedKernel, 3, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(gatherKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(gatherKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(gatherKernel, 2, sizeof(cl_mem), &device_idx);
+	err |= clSetKernelArg(scatterKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(scatterKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(scatterKernel, 2, sizeof(cl_mem), &device_idx);
+	CheckOpenCLError(err, __LINE__);
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function            Useful GB/s   Effective GB/s   Avg time   Min time   Max time   Best Workgroup Size   Queue->Submit   Submit->Start\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (int s = 0; s < NSTRIDES; s++) {
+		cl_ulong stride = strides[s];
+		if (arraySize/stride == 0) break;
+		err  = clSetKernelArg(copyStridedKernel, 2, sizeof(cl_ulong), &stride);
+		err |= clSetKernelArg(triadStridedKernel, 4, sizeof(cl_ulong), &stride);
+		CheckOpenCLError(err, __LINE__);
+
+		// Each accessed item costs its share of the span between accesses, up to a whole line
+		double lineBytes = stride*elementSize < lineSize ? stride*elementSize : lineSize;
+		char testName[64];
+		TestResult result;
+		snprintf(testName, sizeof(testName), "copyStride%zu", strides[s]);
+		RunTest(queue, &copyStridedKernel, 1, arraySize/stride, 0, &result);
+		PrintPatternResult(testName, 2.0*elementSize, 2.0*lineBytes, &result);
+		snprintf(testName, sizeof(testName), "triadStride%zu", strides[s]);
+		RunTest(queue, &triadStridedKernel, 1, arraySize/stride, 0, &result);
+		PrintPatternResult(testName, 3.0*elementSize, 3.0*lineBytes, &result);
+	}
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (int p = 0; p < NPATTERNS; p++) {
+		// Shuffle within blocks of 1 (sequential), SHUFFLEBLOCKSIZE, or the whole array (random). The permutation
+		// works on 4^halfBits numbers, which must cover the block.
+		cl_ulong n = arraySize;
+		cl_ulong blockSize = p == PATTERN_SEQUENTIAL ? 1 : p == PATTERN_BLOCKED ? SHUFFLEBLOCKSIZE : n;
+		cl_uint halfBits = 0;
+		cl_uint seed = PATTERNSEED;
+		while (((cl_ulong)1 << 2*halfBits) < blockSize) halfBits++;
+
+		err  = clSetKernelArg(indexKernel, 0, sizeof(cl_mem), &device_idx);
+		err |= clSetKernelArg(indexKernel, 1, sizeof(cl_ulong), &n);
+		err |= clSetKernelArg(indexKernel, 2, sizeof(cl_ulong), &blockSize);
+		err |= clSetKernelArg(indexKernel, 3, sizeof(cl_uint), &halfBits);
+		err |= clSetKernelArg(indexKernel, 4, sizeof(cl_uint), &seed);
+		size_t globalSize = arraySize;
+		err |= clEnqueueNDRangeKernel(*queue, indexKernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+		clFinish(*queue);
+		CheckOpenCLError(err, __LINE__);
+
+		// The indices and one array are accessed in order. Random indices cost a line for each access of the other.
+		double useful = 2.0*elementSize + sizeof(cl_uint);
+		double effective = p == PATTERN_RANDOM ? elementSize + sizeof(cl_uint) + lineSize : useful;
+		char testName[64];
+		TestResult result;
+		snprintf(testName, sizeof(testName), "gather%s", patternNames[p]);
+		RunTest(queue, &gatherKernel, 1, arraySize, 0, &result);
+		PrintPatternResult(testName, useful, effective, &result);
+		snprintf(testName, sizeof(testName), "scatter%s", patternNames[p]);
+		RunTest(queue, &scatterKernel, 1, arraySize, 0, &result);
+		PrintPatternResult(testName, useful, effective, &result);
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	clReleaseMemObject(device_idx);
+	clReleaseKernel(copyStridedKernel);
+	clReleaseKernel(triadStridedKernel);
+	clReleaseKernel(gatherKernel);
+	clReleaseKernel(scatterKernel);
+	clReleaseKernel(indexKernel);
+}
+
+
+
+// usefulBytes and effectiveBytes are per item processed
+void PrintPatternResult(char *testName, double usefulBytes, double effectiveBytes, TestResult *result)
+{
+	char localSize[32];
+	FormatLocalSize(result->bestLocalSize, localSize, sizeof(localSize));
+
+	printf("%17s   %11.3lf   %14.3lf   %8.6lf   %8.6lf   %8.6lf   %19s   %13.2lf   %13.2lf\n",
+	       testName, usefulBytes*result->items/1024.0/1024.0/1024.0/result->minTime,
+	       effectiveBytes*result->items/1024.0/1024.0/1024.0/result->minTime, result->avgTime,
+	       result->minTime, result->maxTime, localSize, result->queuedToSubmit*1.0e6, result->submitToStart*1.0e6);
+}
+
+
+
+// Bandwidth of local, constant and image memory, next to the scalar global memory copy and triad. Local and
+// constant memory rates count the repeated accesses of each work-item, not the global memory traffic around
+// them. Image rates count float4 pixels, whatever the element type.
+void RunMemorySpaceTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program *program,
+                        cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C,
+                        double scalar, size_t arraySize)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	const size_t nItems = arraySize < MEMSPACEITEMS ? arraySize : MEMSPACEITEMS;
+	cl_ulong localMemSize, constantSize;
+	cl_bool imageSupport;
+	TestResult result;
+	char testName[64], memoryName[32];
+	cl_int err;
+
+	clGetDeviceInfo(*device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMemSize), &localMemSize, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(constantSize), &constantSize, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_IMAGE_SUPPORT, sizeof(imageSupport), &imageSupport, NULL);
+	printf("Local memory: %llu KB, largest constant buffer: %llu KB, image support: %s\n",
+	       (unsigned long long)localMemSize/1024, (unsigned long long)constantSize/1024, imageSupport ? "yes" : "no");
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function            Memory               Best Rate GB/s   Avg time   Min time   Max time   Best Workgroup Size\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	RunTest(queue, &streamKernels[COPY][0], 1, arraySize, 0, &result);
+	PrintMemorySpaceResult("copyKernel1", "global", 2.0*elementSize, &result);
+	RunTest(queue, &streamKernels[TRIAD][0], 1, arraySize, 0, &result);
+	PrintMemorySpaceResult("triadKernel1", "global", 3.0*elementSize, &result);
+
+	// Local memory. The tiles are sized by the local size, so it is fixed rather than tuned.
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	cl_kernel copyLocalKernel = clCreateKernel(*program, "copyLocalKernel", &err);
+	cl_kernel triadLocalKernel = clCreateKernel(*program, "triadLocalKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	size_t localSize = LOCALTILESIZE, maxLocalSize;
+	clGetKernelWorkGroupInfo(copyLocalKernel, *device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, NULL);
+	if (maxLocalSize < localSize) localSize = maxLocalSize;
+	clGetKernelWorkGroupInfo(triadLocalKernel, *device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, NULL);
+	if (maxLocalSize < localSize) localSize = maxLocalSize;
+
+	const cl_uint localRepeats = LOCALREPEATS;
+	err  = clSetKernelArg(copyLocalKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(copyLocalKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(copyLocalKernel, 5, sizeof(cl_uint), &localRepeats);
+	err |= SetScalarKernelArg(&triadLocalKernel, 0, scalar);
+	err |= clSetKernelArg(triadLocalKernel, 1, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(triadLocalKernel, 2, sizeof(cl_mem), device_B);
+	err |= clSetKernelArg(triadLocalKernel, 3, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(triadLocalKernel, 8, sizeof(cl_uint), &localRepeats);
+	CheckOpenCLError(err, __LINE__);
+	for (int s = 0; s < NLOCALSTRIDES; s++) {
+		// Triad has three tiles
+		cl_uint stride = localStrides[s];
+		size_t tileBytes = localSize*stride*elementSize;
+		if (3*tileBytes > localMemSize) break;
+
+		err  = clSetKernelArg(copyLocalKernel, 2, tileBytes, NULL);
+		err |= clSetKernelArg(copyLocalKernel, 3, tileBytes, NULL);
+		err |= clSetKernelArg(copyLocalKernel, 4, sizeof(cl_uint), &stride);
+		err |= clSetKernelArg(triadLocalKernel, 4, tileBytes, NULL);
+		err |= clSetKernelArg(triadLocalKernel, 5, tileBytes, NULL);
+		err |= clSetKernelArg(triadLocalKernel, 6, tileBytes, NULL);
+		err |= clSetKernelArg(triadLocalKernel, 7, sizeof(cl_uint), &stride);
+		CheckOpenCLError(err, __LINE__);
+
+		snprintf(memoryName, sizeof(memoryName), "local, stride %u", stride);
+		TimeLocalSize(queue, &copyLocalKernel, 1, nItems, localSize, MEMSPACENTIMES, 0, &result);
+		PrintMemorySpaceResult("copyLocal", memoryName, 4.0*localRepeats*elementSize, &result);
+		TimeLocalSize(queue, &triadLocalKernel, 1, nItems, localSize, MEMSPACENTIMES, 0, &result);
+		PrintMemorySpaceResult("triadLocal", memoryName, 6.0*localRepeats*elementSize, &result);
+	}
+	clReleaseKernel(copyLocalKernel);
+	clReleaseKernel(triadLocalKernel);
+
+	// Constant memory, from sub-buffers at the start of array A. Each size is read with all work-items on the
+	// same item (broadcast), and on different items.
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	cl_kernel copyConstantKernel = clCreateKernel(*program, "copyConstantKernel", &err);
+	cl_kernel triadConstantKernel = clCreateKernel(*program, "triadConstantKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	const cl_uint constantRepeats = CONSTANTREPEATS;
+	err  = clSetKernelArg(copyConstantKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(copyConstantKernel, 4, sizeof(cl_uint), &constantRepeats);
+	err |= SetScalarKernelArg(&triadConstantKernel, 0, scalar);
+	err |= clSetKernelArg(triadConstantKernel, 2, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(triadConstantKernel, 5, sizeof(cl_uint), &constantRepeats);
+	CheckOpenCLError(err, __LINE__);
+	for (size_t bytes = CONSTANTMINBYTES; bytes <= constantSize && bytes <= arraySize*elementSize; bytes *= 2) {
+		cl_buffer_region region = {0, bytes};
+		cl_mem sub_A = clCreateSubBuffer(*device_A, CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		CheckOpenCLError(err, __LINE__);
+		cl_uint mask = bytes/elementSize - 1;
+		err  = clSetKernelArg(copyConstantKernel, 0, sizeof(cl_mem), &sub_A);
+		err |= clSetKernelArg(copyConstantKernel, 2, sizeof(cl_uint), &mask);
+		err |= clSetKernelArg(triadConstantKernel, 1, sizeof(cl_mem), &sub_A);
+		err |= clSetKernelArg(triadConstantKernel, 3, sizeof(cl_uint), &mask);
+		CheckOpenCLError(err, __LINE__);
+
+		for (cl_uint spread = 0; spread <= 1; spread++) {
+			err  = clSetKernelArg(copyConstantKernel, 3, sizeof(cl_uint), &spread);
+			err |= clSetKernelArg(triadConstantKernel, 4, sizeof(cl_uint), &spread);
+			CheckOpenCLError(err, __LINE__);
+			snprintf(memoryName, sizeof(memoryName), "constant %zu KB", bytes/1024);
+			snprintf(testName, sizeof(testName), "copyConstant%s", spread ? "" : "Bcast");
+			RunTest(queue, &copyConstantKernel, 1, nItems, 0, &result);
+			PrintMemorySpaceResult(testName, memoryName, 1.0*constantRepeats*elementSize, &result);
+			snprintf(testName, sizeof(testName), "triadConstant%s", spread ? "" : "Bcast");
+			RunTest(queue, &triadConstantKernel, 1, nItems, 0, &result);
+			PrintMemorySpaceResult(testName, memoryName, 1.0*constantRepeats*elementSize, &result);
+		}
+		clReleaseMemObject(sub_A);
+	}
+	clReleaseKernel(copyConstantKernel);
+	clReleaseKernel(triadConstantKernel);
+
+	// Images of float4 pixels, each a quarter of an array. The 2D images are copies of the start of arrays B and
+	// C, and the image buffers are views of them.
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	if (!imageSupport) {
+		printf("Device has no image support\n");
+	}
+	else {
+		const cl_image_format format = {CL_RGBA, CL_FLOAT};
+		const cl_float floatScalar = scalar;
+		size_t maxWidth, maxHeight, maxBufferPixels;
+		clGetDeviceInfo(*device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(maxWidth), &maxWidth, NULL);
+		clGetDeviceInfo(*device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(maxHeight), &maxHeight, NULL);
+		clGetDeviceInfo(*device, CL_DEVICE_IMAGE_MAX_BUFFER_SIZE, sizeof(maxBufferPixels), &maxBufferPixels, NULL);
+
+		size_t pixels = arraySize*elementSize/sizeof(cl_float4)/4;
+		cl_uint width = IMAGEWIDTH < maxWidth ? IMAGEWIDTH : maxWidth;
+		if (width > pixels) width = pixels;
+		size_t height = pixels/width < maxHeight ? pixels/width : maxHeight;
+
+		cl_image_desc desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+		desc.image_width = width;
+		desc.image_height = height;
+		cl_mem imageB = clCreateImage(*context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+		cl_mem imageC = clCreateImage(*context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+		CheckOpenCLError(err, __LINE__);
+		size_t origin[3] = {0, 0, 0};
+		size_t region[3] = {width, height, 1};
+		err  = clEnqueueCopyBufferToImage(*queue, *device_B, imageB, 0, origin, region, 0, NULL, NULL);
+		err |= clEnqueueCopyBufferToImage(*queue, *device_C, imageC, 0, origin, region, 0, NULL, NULL);
+		clFinish(*queue);
+		CheckOpenCLError(err, __LINE__);
+
+		cl_kernel copyImage2dKernel = clCreateKernel(*program, "copyImage2dKernel", &err);
+		cl_kernel triadImage2dKernel = clCreateKernel(*program, "triadImage2dKernel", &err);
+		CheckOpenCLError(err, __LINE__);
+		err  = clSetKernelArg(copyImage2dKernel, 0, sizeof(cl_mem), &imageB);
+		err |= clSetKernelArg(copyImage2dKernel, 1, sizeof(cl_mem), device_A);
+		err |= clSetKernelArg(copyImage2dKernel, 2, sizeof(cl_uint), &width);
+		err |= clSetKernelArg(triadImage2dKernel, 0, sizeof(cl_float), &floatScalar);
+		err |= clSetKernelArg(triadImage2dKernel, 1, sizeof(cl_mem), device_A);
+		err |= clSetKernelArg(triadImage2dKernel, 2, sizeof(cl_mem), &imageB);
+		err |= clSetKernelArg(triadImage2dKernel, 3, sizeof(cl_mem), &imageC);
+		err |= clSetKernelArg(triadImage2dKernel, 4, sizeof(cl_uint), &width);
+		CheckOpenCLError(err, __LINE__);
+		printf("image2d: %u x %zu pixels\n", width, height);
+		RunTest(queue, &copyImage2dKernel, 1, width*height, 0, &result);
+		PrintMemorySpaceResult("copyImage2d", "image2d", 2.0*sizeof(cl_float4), &result);
+		RunTest(queue, &triadImage2dKernel, 1, width*height, 0, &result);
+		PrintMemorySpaceResult("triadImage2d", "image2d", 3.0*sizeof(cl_float4), &result);
+		clReleaseKernel(copyImage2dKernel);
+		clReleaseKernel(triadImage2dKernel);
+		clReleaseMemObject(imageB);
+		clReleaseMemObject(imageC);
+
+		// Image buffers are only compiled for OpenCL 1.2 and later devices
+		cl_kernel copyImageBufferKernel = clCreateKernel(*program, "copyImageBufferKernel", &err);
+		cl_kernel triadImageBufferKernel = clCreateKernel(*program, "triadImageBufferKernel", &err);
+		if (err == CL_INVALID_KERNEL_NAME) {
+			printf("Device has no image1d_buffer_t support\n");
+		}
+		else {
+			CheckOpenCLError(err, __LINE__);
+			if (pixels > maxBufferPixels) pixels = maxBufferPixels;
+			memset(&desc, 0, sizeof(desc));
+			desc.image_type = CL_MEM_OBJECT_IMAGE1D_BUFFER;
+			desc.image_width = pixels;
+			desc.buffer = *device_B;
+			imageB = clCreateImage(*context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+			desc.buffer = *device_C;
+			imageC = clCreateImage(*context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+			CheckOpenCLError(err, __LINE__);
+
+			err  = clSetKernelArg(copyImageBufferKernel, 0, sizeof(cl_mem), &imageB);
+			err |= clSetKernelArg(copyImageBufferKernel, 1, sizeof(cl_mem), device_A);
+			err |= clSetKernelArg(triadImageBufferKernel, 0, sizeof(cl_float), &floatScalar);
+			err |= clSetKernelArg(triadImageBufferKernel, 1, sizeof(cl_mem), device_A);
+			err |= clSetKernelArg(triadImageBufferKernel, 2, sizeof(cl_mem), &imageB);
+			err |= clSetKernelArg(triadImageBufferKernel, 3, sizeof(cl_mem), &imageC);
+			CheckOpenCLError(err, __LINE__);
+			printf("image1d_buffer: %zu pixels\n", pixels);
+			RunTest(queue, &copyImageBufferKernel, 1, pixels, 0, &result);
+			PrintMemorySpaceResult("copyImageBuffer", "image1d_buffer", 2.0*sizeof(cl_float4), &result);
+			RunTest(queue, &triadImageBufferKernel, 1, pixels, 0, &result);
+			PrintMemorySpaceResult("triadImageBuffer", "image1d_buffer", 3.0*sizeof(cl_float4), &result);
+			clReleaseKernel(copyImageBufferKernel);
+			clReleaseKernel(triadImageBufferKernel);
+			clReleaseMemObject(imageB);
+			clReleaseMemObject(imageC);
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+
+
+// bytesPerItem is the memory traffic of each item processed
+void PrintMemorySpaceResult(const char *testName, const char *memoryName, double bytesPerItem, TestResult *result)
+{
+	char localSize[32];
+	FormatLocalSize(result->bestLocalSize, localSize, sizeof(localSize));
+
+	printf("%17s   %-18s   %14.3lf   %8.6lf   %8.6lf   %8.6lf   %19s\n",
+	       testName, memoryName, bytesPerItem*result->items/1024.0/1024.0/1024.0/result->minTime, result->avgTime,
+	       result->minTime, result->maxTime, localSize);
+}
+
+
+
+// Bandwidth against the mix of reads and writes, at one vector width. The read-only kernel sums READITEMS items
+// per work-item and writes one, the fill kernel only writes, and the ratio kernels read N and write M items per
+// work-item, from and to N and M blocks of a MAXRATIO'th of arrays A and C. Rates count both reads and writes.
+// Non-temporal stores are only built where the compiler has a builtin for them.
+void RunReadWriteTest(cl_command_queue *queue, cl_program *program, cl_mem *device_A, cl_mem *device_C, double scalar,
+                      size_t arraySize, size_t vecWidth)
+{
+	const cl_ulong blockItems = arraySize/vecWidth/MAXRATIO;
+	const cl_uint readItems = READITEMS;
+	TestResult result, nontemporalResult;
+	char testName[64];
+	cl_int err;
+
+	cl_kernel readKernel = clCreateKernel(*program, "readKernel", &err);
+	cl_kernel fillKernel = clCreateKernel(*program, "fillKernel", &err);
+	cl_kernel ratioKernel = clCreateKernel(*program, "ratioKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel fillNontemporalKernel = clCreateKernel(*program, "fillNontemporalKernel", &err);
+	cl_kernel ratioNontemporalKernel = clCreateKernel(*program, "ratioNontemporalKernel", &err);
+	int haveNontemporal = (err != CL_INVALID_KERNEL_NAME);
+	if (haveNontemporal) CheckOpenCLError(err, __LINE__);
+
+	err  = clSetKernelArg(readKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(readKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(readKernel, 2, sizeof(cl_uint), &readItems);
+	err |= clSetKernelArg(fillKernel, 0, sizeof(cl_mem), device_C);
+	err |= SetScalarKernelArg(&fillKernel, 1, scalar);
+	err |= clSetKernelArg(ratioKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(ratioKernel, 1, sizeof(cl_mem), device_C);
+	err |= clSetKernelArg(ratioKernel, 2, sizeof(cl_ulong), &blockItems);
+	if (haveNontemporal) {
+		err |= clSetKernelArg(fillNontemporalKernel, 0, sizeof(cl_mem), device_C);
+		err |= SetScalarKernelArg(&fillNontemporalKernel, 1, scalar);
+		err |= clSetKernelArg(ratioNontemporalKernel, 0, sizeof(cl_mem), device_A);
+		err |= clSetKernelArg(ratioNontemporalKernel, 1, sizeof(cl_mem), device_C);
+		err |= clSetKernelArg(ratioNontemporalKernel, 2, sizeof(cl_ulong), &blockItems);
+	}
+	CheckOpenCLError(err, __LINE__);
+
+	printf("Vector width %zu, non-temporal stores: %s\n", vecWidth, haveNontemporal ? "yes" : "not supported by the compiler");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function         Reads:Writes   Rate GB/s   Read GB/s   Write GB/s   Avg time   Min time   Max time   Workgroup   Non-temporal GB/s\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	snprintf(testName, sizeof(testName), "readKernel%zu", vecWidth);
+	RunTest(queue, &readKernel, vecWidth, arraySize/READITEMS, 0, &result);
+	PrintReadWriteResult(testName, READITEMS, 1, &result, NULL);
+
+	snprintf(testName, sizeof(testName), "fillKernel%zu", vecWidth);
+	RunTest(queue, &fillKernel, vecWidth, arraySize, 0, &result);
+	if (haveNontemporal) RunTest(queue, &fillNontemporalKernel, vecWidth, arraySize, 0, &nontemporalResult);
+	PrintReadWriteResult(testName, 0, 1, &result, haveNontemporal ? &nontemporalResult : NULL);
+
+	for (cl_uint nReads = 1; nReads <= MAXRATIO; nReads++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (cl_uint nWrites = 1; nWrites <= MAXRATIO; nWrites++) {
+			err  = clSetKernelArg(ratioKernel, 3, sizeof(cl_uint), &nReads);
+			err |= clSetKernelArg(ratioKernel, 4, sizeof(cl_uint), &nWrites);
+			if (haveNontemporal) {
+				err |= clSetKernelArg(ratioNontemporalKernel, 3, sizeof(cl_uint), &nReads);
+				err |= clSetKernelArg(ratioNontemporalKernel, 4, sizeof(cl_uint), &nWrites);
+			}
+			CheckOpenCLError(err, __LINE__);
+
+			snprintf(testName, sizeof(testName), "ratioKernel%zu", vecWidth);
+			RunTest(queue, &ratioKernel, vecWidth, blockItems*vecWidth, 0, &result);
+			if (haveNontemporal) RunTest(queue, &ratioNontemporalKernel, vecWidth, blockItems*vecWidth, 0, &nontemporalResult);
+			PrintReadWriteResult(testName, nReads, nWrites, &result, haveNontemporal ? &nontemporalResult : NULL);
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	clReleaseKernel(readKernel);
+	clReleaseKernel(fillKernel);
+	clReleaseKernel(ratioKernel);
+	if (haveNontemporal) {
+		clReleaseKernel(fillNontemporalKernel);
+		clReleaseKernel(ratioNontemporalKernel);
+	}
+}
+
+
+
+// Rates of the reads and writes of one work-item each. The non-temporal result, if any, is given as its total rate.
+void PrintReadWriteResult(const char *testName, int nReads, int nWrites, TestResult *result, TestResult *nontemporalResult)
+{
+	const double elementSize = elementTypes[elementType].size;
+	const double itemsPerSecond = result->items/result->minTime;
+	char localSize[32], ratio[16], nontemporal[32];
+	FormatLocalSize(result->bestLocalSize, localSize, sizeof(localSize));
+	snprintf(ratio, sizeof(ratio), "%d:%d", nReads, nWrites);
+	if (nontemporalResult != NULL) {
+		snprintf(nontemporal, sizeof(nontemporal), "%.3lf",
+		         (nReads + nWrites)*elementSize*nontemporalResult->items/1024.0/1024.0/1024.0/nontemporalResult->minTime);
+	}
+	else {
+		snprintf(nontemporal, sizeof(nontemporal), "-");
+	}
+
+	printf("%14s   %12s   %9.3lf   %9.3lf   %10.3lf   %8.6lf   %8.6lf   %8.6lf   %9s   %17s\n",
+	       testName, ratio, (nReads + nWrites)*elementSize*itemsPerSecond/1024.0/1024.0/1024.0,
+	       nReads*elementSize*itemsPerSecond/1024.0/1024.0/1024.0, nWrites*elementSize*itemsPerSecond/1024.0/1024.0/1024.0,
+	       result->avgTime, result->minTime, result->maxTime, localSize, nontemporal);
+}
+
+
+
+// Memory latency by pointer chasing, over list footprints from CHASEMINBYTES up to the size of array A, which
+// holds the list. The first table is the time per load against footprint for each number of concurrent chains.
+// The second is the loaded-latency curve at the largest footprint: time per load, and the total rate of loads,
+// as the number of chains rises. Chains are one work-item each, in work-groups of one so they spread over the
+// compute units.
+void RunLatencyTest(cl_command_queue *queue, cl_program *program, cl_mem *device_A, cl_mem *device_B, size_t maxBytes)
+{
+	cl_int err;
+
+	// The list indices are 32 bit. Footprints double, so the largest is a power of two.
+	cl_ulong maxItems = maxBytes/sizeof(cl_uint);
+	if (maxItems > CL_UINT_MAX) maxItems = (cl_ulong)CL_UINT_MAX + 1;
+	size_t nSizes = 0;
+	cl_ulong sizes[SWEEPMAXSTEPS];
+	for (cl_ulong n = CHASEMINBYTES/sizeof(cl_uint); n <= maxItems && nSizes < SWEEPMAXSTEPS; n *= 2) {
+		sizes[nSizes++] = n;
+	}
+
+	cl_kernel chaseInitKernel = clCreateKernel(*program, "chaseInitKernel", &err);
+	cl_kernel chaseKernel = clCreateKernel(*program, "chaseKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	const cl_ulong nLoads = CHASELOADS;
+	const cl_uint seed = PATTERNSEED;
+	err  = clSetKernelArg(chaseInitKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(chaseInitKernel, 3, sizeof(cl_uint), &seed);
+	err |= clSetKernelArg(chaseKernel, 0, sizeof(cl_mem), device_A);
+	err |= clSetKernelArg(chaseKernel, 2, sizeof(cl_ulong), &nLoads);
+	err |= clSetKernelArg(chaseKernel, 3, sizeof(cl_mem), device_B);
+	CheckOpenCLError(err, __LINE__);
+
+	printf("Pointer chase, %llu dependent loads per chain. Time per load in ns for each number of chains:\n",
+	       (unsigned long long)nLoads);
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Footprint KB");
+	for (int c = 0; c < NCHASECHAINS; c++) {
+		char chainsName[32];
+		snprintf(chainsName, sizeof(chainsName), "%zu chain%s", chaseChains[c], chaseChains[c] == 1 ? "" : "s");
+		printf("   %11s", chainsName);
+	}
+	printf("\n-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (size_t i = 0; i < nSizes; i++) {
+		BuildChaseList(queue, &chaseInitKernel, sizes[i]);
+		printf("%12.1lf", sizes[i]*sizeof(cl_uint)/1024.0);
+		for (int c = 0; c < NCHASECHAINS; c++) {
+			// Chains closer together than CHASEMINSPACING items would follow each other through the same loads
+			if (chaseChains[c]*CHASEMINSPACING > sizes[i]) {
+				printf("   %11s", "-");
+				continue;
+			}
+			printf("   %11.2lf", ChaseTime(queue, &chaseKernel, sizes[i], chaseChains[c])/nLoads*1.0e9);
+		}
+		printf("\n");
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	// Loaded latency, with the list from the last row still in place
+	cl_ulong n = sizes[nSizes-1];
+	printf("Loaded latency at %.1lf KB footprint\n", n*sizeof(cl_uint)/1024.0);
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Chains   ns per load   Mloads/s\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (size_t chains = 1; chains <= CHASEMAXCHAINS && chains*CHASEMINSPACING <= n; chains *= 2) {
+		double time = ChaseTime(queue, &chaseKernel, n, chains);
+		printf("%6zu   %11.2lf   %8.2lf\n", chains, time/nLoads*1.0e9, chains*nLoads/time/1.0e6);
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	clReleaseKernel(chaseInitKernel);
+	clReleaseKernel(chaseKernel);
+}
+
+
+
+// Link the first n items of the list into a random cycle
+void BuildChaseList(cl_command_queue *queue, cl_kernel *chaseInitKernel, cl_ulong n)
+{
+	cl_uint halfBits = 0;
+	while (((cl_ulong)1 << 2*halfBits) < n) halfBits++;
+
+	cl_int err;
+	err  = clSetKernelArg(*chaseInitKernel, 1, sizeof(cl_ulong), &n);
+	err |= clSetKernelArg(*chaseInitKernel, 2, sizeof(cl_uint), &halfBits);
+	size_t globalSize = n;
+	err |= clEnqueueNDRangeKernel(*queue, *chaseInitKernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+	clFinish(*queue);
+	CheckOpenCLError(err, __LINE__);
+}
+
+
+
+// Fastest time in seconds of CHASENTIMES launches of nChains chains through a list of n items
+double ChaseTime(cl_command_queue *queue, cl_kernel *chaseKernel, cl_ulong n, size_t nChains)
+{
+	cl_int err = clSetKernelArg(*chaseKernel, 1, sizeof(cl_ulong), &n);
+	CheckOpenCLError(err, __LINE__);
+
+	TestResult result;
+	TimeKernel(queue, chaseKernel, nChains, 1, CHASENTIMES, 0, &result);
+	return result.minTime;
+}
+
+
+
+// Measure host<->device transfer bandwidth and time per transfer, for each transfer method over a range
+// of sizes. device_A is the device side of every transfer, and the source of device to device copies is
+// device_B. Host memory is touched before timing, and the best of TRANSFERNTIMES transfers is kept. Returns
+// EXIT_FAILURE if the host memory can't be allocated.
+int RunTransferTest(cl_context *context, cl_command_queue *queue, cl_mem *device_A, cl_mem *device_B, size_t maxBytes)
+{
+	cl_int err;
+
+	// Host memory for each method: plain malloc memory, a mapped CL_MEM_ALLOC_HOST_PTR buffer (pinned
+	// by most runtimes), and page-aligned memory wrapped in a CL_MEM_USE_HOST_PTR buffer.
+	void *pageable = malloc(maxBytes);
+	if (pageable == NULL) {
+		printf("Error allocating host memory, line %d\n", __LINE__);
+		return EXIT_FAILURE;
+	}
+	memset(pageable, 0, maxBytes);
+
+	cl_mem pinnedBuffer = clCreateBuffer(*context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, maxBytes, NULL, &err);
+	CheckOpenCLError(err, __LINE__);
+	void *pinned = clEnqueueMapBuffer(*queue, pinnedBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, maxBytes, 0, NULL, NULL, &err);
+	CheckOpenCLError(err, __LINE__);
+	memset(pinned, 0, maxBytes);
+
+	void *aligned;
+	if (posix_memalign(&aligned, HOSTPTRALIGN, maxBytes) != 0) {
+		printf("Error allocating aligned host memory, line %d\n", __LINE__);
+		clEnqueueUnmapMemObject(*queue, pinnedBuffer, pinned, 0, NULL, NULL);
+		clFinish(*queue);
+		clReleaseMemObject(pinnedBuffer);
+		free(pageable);
+		return EXIT_FAILURE;
+	}
+	memset(aligned, 0, maxBytes);
+	cl_mem hostPtrBuffer = clCreateBuffer(*context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, maxBytes, aligned, &err);
+	CheckOpenCLError(err, __LINE__);
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Transfer method              Size KB   Host->Device GB/s   Host->Device us   Device->Host GB/s   Device->Host us\n");
+	for (int m = 0; m < NTRANSFERS; m++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (size_t bytes = TRANSFERMINSIZE; bytes <= maxBytes; bytes *= 4) {
+			double bestTime[2] = {DBL_MAX, DBL_MAX};
+
+			// Device to device copies only have one direction
+			for (int toHost = 0; toHost < (m == TRANSFER_DEVICECOPY ? 1 : 2); toHost++) {
+				for (int n = 0; n < TRANSFERNTIMES; n++) {
+					double time = GetWallTime();
+					void *mapped;
+
+					switch (m) {
+						case TRANSFER_PAGEABLE:
+						case TRANSFER_PINNED:
+							if (toHost) err = clEnqueueReadBuffer(*queue, *device_A, CL_TRUE, 0, bytes,
+							                                      m == TRANSFER_PINNED ? pinned : pageable, 0, NULL, NULL);
+							else err = clEnqueueWriteBuffer(*queue, *device_A, CL_TRUE, 0, bytes,
+							                                m == TRANSFER_PINNED ? pinned : pageable, 0, NULL, NULL);
+							break;
+						case TRANSFER_HOSTPTR:
+							if (toHost) err = clEnqueueCopyBuffer(*queue, *device_A, hostPtrBuffer, 0, 0, bytes, 0, NULL, NULL);
+							else err = clEnqueueCopyBuffer(*queue, hostPtrBuffer, *device_A, 0, 0, bytes, 0, NULL, NULL);
+							clFinish(*queue);
+							break;
+						case TRANSFER_MAP:
+							// The data still has to be moved through the mapped pointer
+							mapped = clEnqueueMapBuffer(*queue, *device_A, CL_TRUE, toHost ? CL_MAP_READ : CL_MAP_WRITE_INVALIDATE_REGION,
+							                            0, bytes, 0, NULL, NULL, &err);
+							CheckOpenCLError(err, __LINE__);
+							if (toHost) memcpy(pageable, mapped, bytes);
+							else memcpy(mapped, pageable, bytes);
+							err = clEnqueueUnmapMemObject(*queue, *device_A, mapped, 0, NULL, NULL);
+							clFinish(*queue);
+							break;
+						case TRANSFER_DEVICECOPY:
+							err = clEnqueueCopyBuffer(*queue, *device_B, *device_A, 0, 0, bytes, 0, NULL, NULL);
+							clFinish(*queue);
+							break;
+					}
+					CheckOpenCLError(err, __LINE__);
+
+					time = GetWallTime() - time;
+					if (time < bestTime[toHost]) bestTime[toHost] = time;
+				}
+			}
+
+			printf("%-23s   %10.1lf   %17.3lf   %15.2lf", bytes == TRANSFERMINSIZE ? transferNames[m] : "",
+			       bytes/1024.0, bytes/1024.0/1024.0/1024.0/bestTime[0], bestTime[0]*1.0e6);
+			if (m == TRANSFER_DEVICECOPY) {
+				printf("   %17s   %15s\n", "-", "-");
+			}
+			else {
+				printf("   %17.3lf   %15.2lf\n", bytes/1024.0/1024.0/1024.0/bestTime[1], bestTime[1]*1.0e6);
+			}
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	clReleaseMemObject(hostPtrBuffer);
+	free(aligned);
+	clEnqueueUnmapMemObject(*queue, pinnedBuffer, pinned, 0, NULL, NULL);
+	clFinish(*queue);
+	clReleaseMemObject(pinnedBuffer);
+	free(pageable);
+	return EXIT_SUCCESS;
+}
+
+
+
+// Triad over host arrays larger than device memory, streamed through the device in chunks. Each of nBuffers chunk
+// buffers (sub-buffers of the device arrays) has its own in-order queue, which uploads B and C, runs the triad and
+// downloads A, so the transfers and kernels of different chunks overlap and a buffer isn't reused before its
+// download is done. One buffer is the serial baseline. Each configuration runs twice: transferring straight from
+// and to the pageable host arrays, which most runtimes copy through their own bounce buffers without overlapping
+// them with kernels, and staged through pinned memory, a mapped CL_MEM_ALLOC_HOST_PTR buffer of each array per chunk
+// buffer that the host copies the chunks into and out of. End-to-end bandwidth is the host data moved over the host
+// wall time. Overlap is how much of the possible saving over running the stages one after the other was made:
+// (serial - actual)/(serial - slowest stage), from the device times of each stage. Returns EXIT_FAILURE if the
+// host result is wrong.
+int RunOutOfCoreTest(cl_device_id *device, cl_context *context, cl_program *program, cl_mem *device_A, cl_mem *device_B,
+                     cl_mem *device_C, double scalar, size_t deviceArrayBytes, cl_ulong globalMemSize, size_t vecWidth)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	const char * const bufferingNames[OOCMAXBUFFERS] = {"single", "double", "triple"};
+	const char * const stagingNames[2] = {"pageable", "pinned"};
+	cl_command_queue queues[OOCMAXBUFFERS];
+	cl_mem slot_A[OOCMAXBUFFERS], slot_B[OOCMAXBUFFERS], slot_C[OOCMAXBUFFERS];
+	cl_mem pinned_A[OOCMAXBUFFERS], pinned_B[OOCMAXBUFFERS], pinned_C[OOCMAXBUFFERS];
+	void *stage_A[OOCMAXBUFFERS], *stage_B[OOCMAXBUFFERS], *stage_C[OOCMAXBUFFERS];
+	cl_kernel kernels[OOCMAXBUFFERS];
+	cl_int err;
+
+	// Each host array is as large as device memory, if host memory allows, and a multiple of 16 items
+	double hostMemSize = (double)sysconf(_SC_PHYS_PAGES)*sysconf(_SC_PAGESIZE);
+	size_t hostBytes = globalMemSize;
+	if (3.0*hostBytes > OOCHOSTFRACTION*hostMemSize) hostBytes = OOCHOSTFRACTION*hostMemSize/3.0;
+	size_t hostItems = hostBytes/elementSize/16*16;
+	hostBytes = hostItems*elementSize;
+
+	void *host_A = NULL, *host_B = NULL, *host_C = NULL;
+	if (posix_memalign(&host_A, HOSTPTRALIGN, hostBytes) != 0 || posix_memalign(&host_B, HOSTPTRALIGN, hostBytes) != 0
+	    || posix_memalign(&host_C, HOSTPTRALIGN, hostBytes) != 0) {
+		printf("Error allocating %.1lf MB host arrays, line %d\n", hostBytes/1024.0/1024.0, __LINE__);
+		free(host_A);
+		free(host_B);
+		free(host_C);
+		return EXIT_FAILURE;
+	}
+	memset(host_A, 0, hostBytes);
+	FillElements(host_B, hostItems, 2.0);
+	FillElements(host_C, hostItems, 1.0);
+	printf("Host arrays: 3 x %.1lf MB, device memory: %.1lf MB%s\n", hostBytes/1024.0/1024.0, globalMemSize/1024.0/1024.0,
+	       3.0*hostBytes > globalMemSize ? "" : " (limited by host memory, the arrays fit on the device)");
+
+	for (int q = 0; q < OOCMAXBUFFERS; q++) {
+		queues[q] = clCreateCommandQueue(*context, *device, CL_QUEUE_PROFILING_ENABLE, &err);
+		CheckOpenCLError(err, __LINE__);
+		kernels[q] = clCreateKernel(*program, "triadKernel", &err);
+		CheckOpenCLError(err, __LINE__);
+	}
+
+	double bestRate = 0.0;
+	size_t bestChunkBytes = 0;
+	int bestBuffers = 0, bestPinned = 0;
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Host       Buffering   Chunk MB    Chunks   End-to-end GB/s   Upload GB/s   Triad GB/s   Download GB/s   Device time   Overlap\n");
+	for (int pinned = 0; pinned < 2; pinned++) {
+		for (int nBuffers = 1; nBuffers <= OOCMAXBUFFERS; nBuffers++) {
+			printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+			for (size_t chunkBytes = OOCMINCHUNK; chunkBytes*nBuffers <= deviceArrayBytes && chunkBytes < 4*hostBytes;
+			     chunkBytes *= 4) {
+				const size_t chunkItems = chunkBytes/elementSize;
+				const size_t nChunks = (hostItems + chunkItems - 1)/chunkItems;
+				cl_event *events = malloc(4*nChunks*sizeof(cl_event));
+
+				for (int b = 0; b < nBuffers; b++) {
+					cl_buffer_region region = {b*chunkBytes, chunkBytes};
+					slot_A[b] = clCreateSubBuffer(*device_A, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+					CheckOpenCLError(err, __LINE__);
+					slot_B[b] = clCreateSubBuffer(*device_B, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+					CheckOpenCLError(err, __LINE__);
+					slot_C[b] = clCreateSubBuffer(*device_C, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+					CheckOpenCLError(err, __LINE__);
+					SetStreamKernelArg(&kernels[b], TRIAD, &slot_A[b], &slot_B[b], &slot_C[b], scalar);
+					if (pinned) {
+						pinned_A[b] = clCreateBuffer(*context, CL_MEM_ALLOC_HOST_PTR, chunkBytes, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+						pinned_B[b] = clCreateBuffer(*context, CL_MEM_ALLOC_HOST_PTR, chunkBytes, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+						pinned_C[b] = clCreateBuffer(*context, CL_MEM_ALLOC_HOST_PTR, chunkBytes, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+						stage_A[b] = clEnqueueMapBuffer(queues[b], pinned_A[b], CL_TRUE, CL_MAP_READ, 0, chunkBytes,
+						                                0, NULL, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+						stage_B[b] = clEnqueueMapBuffer(queues[b], pinned_B[b], CL_TRUE, CL_MAP_WRITE, 0, chunkBytes,
+						                                0, NULL, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+						stage_C[b] = clEnqueueMapBuffer(queues[b], pinned_C[b], CL_TRUE, CL_MAP_WRITE, 0, chunkBytes,
+						                                0, NULL, NULL, &err);
+						CheckOpenCLError(err, __LINE__);
+					}
+				}
+
+				// With staging, a chunk buffer's staging memory is only reused once its previous chunk is downloaded and
+				// copied out, nBuffers chunks later, so the loop runs on for the last nBuffers chunks to copy them out
+				double wallTime = GetWallTime();
+				err = CL_SUCCESS;
+				for (size_t i = 0; i < nChunks + (pinned ? nBuffers : 0); i++) {
+					const int b = i % nBuffers;
+					if (pinned && i >= (size_t)nBuffers) {
+						const size_t j = i - nBuffers;
+						const size_t items = hostItems - j*chunkItems < chunkItems ? hostItems - j*chunkItems : chunkItems;
+						err |= clWaitForEvents(1, &events[4*j + 3]);
+						memcpy((char *)host_A + j*chunkItems*elementSize, stage_A[b], items*elementSize);
+					}
+					if (i >= nChunks) continue;
+
+					const size_t offset = i*chunkItems*elementSize;
+					const size_t items = hostItems - i*chunkItems < chunkItems ? hostItems - i*chunkItems : chunkItems;
+					const size_t globalSize = items/vecWidth;
+					void *src_B = (char *)host_B + offset, *src_C = (char *)host_C + offset, *dst_A = (char *)host_A + offset;
+					if (pinned) {
+						memcpy(stage_B[b], src_B, items*elementSize);
+						memcpy(stage_C[b], src_C, items*elementSize);
+						src_B = stage_B[b];
+						src_C = stage_C[b];
+						dst_A = stage_A[b];
+					}
+
+					err |= clEnqueueWriteBuffer(queues[b], slot_B[b], CL_FALSE, 0, items*elementSize, src_B, 0, NULL,
+					                            &events[4*i]);
+					err |= clEnqueueWriteBuffer(queues[b], slot_C[b], CL_FALSE, 0, items*elementSize, src_C, 0, NULL,
+					                            &events[4*i + 1]);
+					err |= SetItemCountArg(&kernels[b], globalSize);
+					err |= clEnqueueNDRangeKernel(queues[b], kernels[b], 1, NULL, &globalSize, NULL, 0, NULL, &events[4*i + 2]);
+					err |= clEnqueueReadBuffer(queues[b], slot_A[b], CL_FALSE, 0, items*elementSize, dst_A, 0, NULL,
+					                           &events[4*i + 3]);
+					clFlush(queues[b]);
+				}
+				for (int b = 0; b < nBuffers; b++) clFinish(queues[b]);
+				wallTime = GetWallTime() - wallTime;
+				CheckOpenCLError(err, __LINE__);
+
+				// Busy time of each stage, and the device time from the first upload starting to the last download ending
+				double uploadTime = 0.0, triadTime = 0.0, downloadTime = 0.0;
+				cl_ulong firstStart = ~(cl_ulong)0, lastEnd = 0;
+				for (size_t i = 0; i < nChunks; i++) {
+					uploadTime += GetEventTime(events[4*i], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+					uploadTime += GetEventTime(events[4*i + 1], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+					triadTime += GetEventTime(events[4*i + 2], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+					downloadTime += GetEventTime(events[4*i + 3], CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END);
+					cl_ulong t = GetEventTimestamp(events[4*i], CL_PROFILING_COMMAND_START);
+					if (t < firstStart) firstStart = t;
+					t = GetEventTimestamp(events[4*i + 3], CL_PROFILING_COMMAND_END);
+					if (t > lastEnd) lastEnd = t;
+					for (int e = 0; e < 4; e++) clReleaseEvent(events[4*i + e]);
+				}
+				free(events);
+				for (int b = 0; b < nBuffers; b++) {
+					clReleaseMemObject(slot_A[b]);
+					clReleaseMemObject(slot_B[b]);
+					clReleaseMemObject(slot_C[b]);
+					if (pinned) {
+						clEnqueueUnmapMemObject(queues[b], pinned_A[b], stage_A[b], 0, NULL, NULL);
+						clEnqueueUnmapMemObject(queues[b], pinned_B[b], stage_B[b], 0, NULL, NULL);
+						clEnqueueUnmapMemObject(queues[b], pinned_C[b], stage_C[b], 0, NULL, NULL);
+						clFinish(queues[b]);
+						clReleaseMemObject(pinned_A[b]);
+						clReleaseMemObject(pinned_B[b]);
+						clReleaseMemObject(pinned_C[b]);
+					}
+				}
+
+				double deviceTime = 1e-9*(lastEnd - firstStart);
+				double serialTime = uploadTime + triadTime + downloadTime;
+				double slowestStage = uploadTime > triadTime ? uploadTime : triadTime;
+				if (downloadTime > slowestStage) slowestStage = downloadTime;
+				double overlap = serialTime > slowestStage ? (serialTime - deviceTime)/(serialTime - slowestStage) : 0.0;
+				if (overlap < 0.0) overlap = 0.0;
+
+				double rate = 3.0*hostBytes/1024.0/1024.0/1024.0/wallTime;
+				if (rate > bestRate) {
+					bestRate = rate;
+					bestChunkBytes = chunkBytes;
+					bestBuffers = nBuffers;
+					bestPinned = pinned;
+				}
+				printf("%-8s   %9s   %8.1lf   %7zu   %15.3lf   %11.3lf   %10.3lf   %13.3lf   %11.6lf   %6.1lf%%\n",
+				       nBuffers == 1 && chunkBytes == OOCMINCHUNK ? stagingNames[pinned] : "",
+				       chunkBytes == OOCMINCHUNK ? bufferingNames[nBuffers-1] : "", chunkBytes/1024.0/1024.0, nChunks, rate,
+				       2.0*hostBytes/1024.0/1024.0/1024.0/uploadTime, 3.0*hostBytes/1024.0/1024.0/1024.0/triadTime,
+				       hostBytes/1024.0/1024.0/1024.0/downloadTime, deviceTime, overlap*100.0);
+			}
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Best: %s buffering with %.1lf MB chunks from %s host memory, %.3lf GB/s end to end\n",
+	       bestBuffers ? bufferingNames[bestBuffers-1] : "-", bestChunkBytes/1024.0/1024.0, stagingNames[bestPinned], bestRate);
+
+	for (int q = 0; q < OOCMAXBUFFERS; q++) {
+		clReleaseKernel(kernels[q]);
+		clReleaseCommandQueue(queues[q]);
+	}
+
+	// Every run writes the whole of A, so the last one is checked
+	const double expected = 2.0*scalar + 1.0;
+	size_t errors = 0, firstError = 0;
+	for (size_t i = 0; i < hostItems; i++) {
+		if (GetElement(host_A, i) != expected) {
+			if (errors == 0) firstError = i;
+			errors++;
+		}
+	}
+	int status = EXIT_SUCCESS;
+	if (errors > 0) {
+		printf("Failed validation of host array A: %zu of %zu items wrong, first at index %zu is %.6lg, expected %.6lg\n",
+		       errors, hostItems, firstError, GetElement(host_A, firstError), expected);
+		status = EXIT_FAILURE;
+	}
+	else {
+		printf("Solution validates on the host: A = %.6lg\n", expected);
+	}
+
+	free(host_A);
+	free(host_B);
+	free(host_C);
+	return status;
+}
+
+
+
+// Launch overhead, on an in-order and (if the device has them) an out-of-order queue without profiling. Throughput
+// is LAUNCHBATCH empty kernels enqueued back to back, then one clFinish. Latency is from enqueueing one empty
+// kernel to the host seeing it complete: through clFinish, clWaitForEvents, or an event callback that the host
+// spins waiting for. The crossover sweep times single triad launches to completion over doubling array sizes, and
+// the crossover is the smallest size where a launch takes twice as long as an empty one, when moving the data
+// costs more than the launch.
+void RunLaunchTest(cl_device_id *device, cl_context *context, cl_program programs[], cl_mem *device_A, cl_mem *device_B,
+                   cl_mem *device_C, double scalar, size_t arraySize, size_t vecWidth)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	const char * const queueNames[2] = {"in-order", "out-of-order"};
+	const char * const syncNames[3] = {"clFinish", "clWaitForEvents", "callback"};
+	cl_command_queue queues[2];
+	cl_command_queue_properties queueProperties;
+	double emptyLatency[2];
+	double *times = malloc(LAUNCHTIMES*sizeof(double));
+	int callbackDone;
+	size_t one = 1;
+	TestResult result;
+	cl_int err;
+
+	clGetDeviceInfo(*device, CL_DEVICE_QUEUE_PROPERTIES, sizeof(queueProperties), &queueProperties, NULL);
+	const int nQueues = (queueProperties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) ? 2 : 1;
+	queues[0] = clCreateCommandQueue(*context, *device, 0, &err);
+	CheckOpenCLError(err, __LINE__);
+	if (nQueues == 2) {
+		queues[1] = clCreateCommandQueue(*context, *device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+		CheckOpenCLError(err, __LINE__);
+	}
+	else {
+		printf("Device has no out-of-order queues\n");
+	}
+
+	int v = 0;
+	while (vecWidths[v] != vecWidth) v++;
+	cl_kernel emptyKernel = clCreateKernel(programs[0], "emptyKernel", &err);
+	cl_kernel triadKernel = clCreateKernel(programs[v], "triadKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	SetStreamKernelArg(&triadKernel, TRIAD, device_A, device_B, device_C, scalar);
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Queue          Launches/s   Enqueue us   Sync method       Median us      Min us      P95 us\n");
+	for (int q = 0; q < nQueues; q++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		// Throughput, after warm-up launches
+		err = CL_SUCCESS;
+		for (int n = 0; n < warmupTimes; n++) {
+			err |= clEnqueueNDRangeKernel(queues[q], emptyKernel, 1, NULL, &one, NULL, 0, NULL, NULL);
+		}
+		clFinish(queues[q]);
+		double startTime = GetWallTime();
+		for (int n = 0; n < LAUNCHBATCH; n++) {
+			err |= clEnqueueNDRangeKernel(queues[q], emptyKernel, 1, NULL, &one, NULL, 0, NULL, NULL);
+		}
+		double enqueueTime = GetWallTime() - startTime;
+		clFinish(queues[q]);
+		double batchTime = GetWallTime() - startTime;
+		CheckOpenCLError(err, __LINE__);
+
+		// Latency of a single launch, by each way of waiting for it. A failure abandons that way's measurement,
+		// rather than waiting for a completion that may never come.
+		for (int sync = 0; sync < 3; sync++) {
+			int failed = 0;
+			for (int n = -warmupTimes; n < LAUNCHTIMES && !failed; n++) {
+				cl_event event;
+				startTime = GetWallTime();
+				err = clEnqueueNDRangeKernel(queues[q], emptyKernel, 1, NULL, &one, NULL, 0, NULL, sync ? &event : NULL);
+				if (err == CL_SUCCESS) {
+					switch (sync) {
+						case 0:
+							err = clFinish(queues[q]);
+							break;
+						case 1:
+							err = clWaitForEvents(1, &event);
+							break;
+						case 2:
+							__atomic_store_n(&callbackDone, 0, __ATOMIC_RELAXED);
+							err = clSetEventCallback(event, CL_COMPLETE, LaunchCallback, &callbackDone);
+							if (err == CL_SUCCESS) err = clFlush(queues[q]);
+							while (err == CL_SUCCESS && !__atomic_load_n(&callbackDone, __ATOMIC_ACQUIRE)) {}
+							break;
+					}
+					if (sync) clReleaseEvent(event);
+				}
+				double time = GetWallTime() - startTime;
+				CheckOpenCLError(err, __LINE__);
+				failed = (err != CL_SUCCESS);
+				if (n >= 0) times[n] = time;
+			}
+
+			if (sync == 0) {
+				printf("%-12s   %10.0lf   %10.2lf", queueNames[q], LAUNCHBATCH/batchTime, enqueueTime/LAUNCHBATCH*1.0e6);
+			}
+			else {
+				printf("%12s   %10s   %10s", "", "", "");
+			}
+			if (failed) {
+				if (sync == 0) emptyLatency[q] = 0.0;
+				printf("   %-15s   %9s   %9s   %9s\n", syncNames[sync], "failed", "-", "-");
+				continue;
+			}
+			GetTimeStatistics(times, LAUNCHTIMES, &result);
+			if (sync == 0) emptyLatency[q] = result.medianTime;
+			printf("   %-15s   %9.2lf   %9.2lf   %9.2lf\n", syncNames[sync], result.medianTime*1.0e6, result.minTime*1.0e6,
+			       result.p95Time*1.0e6);
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	// Crossover sweep. Each size is timed on each queue before going on to the next.
+	size_t crossover[2] = {0, 0};
+	printf("\nTriad launch to completion (clFinish) against array size, vector width %zu\n", vecWidth);
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("    Size KB   In-order us   In-order GB/s   Out-of-order us   Out-of-order GB/s\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (size_t bytes = CROSSOVERMINBYTES; bytes <= arraySize*elementSize; bytes *= 2) {
+		size_t globalSize = bytes/elementSize/vecWidth;
+		if (globalSize == 0) continue;
+		printf("%11.1lf", bytes/1024.0);
+		for (int q = 0; q < 2; q++) {
+			if (q >= nQueues) {
+				printf("   %15s   %17s", "-", "-");
+				continue;
+			}
+			err = SetItemCountArg(&triadKernel, globalSize);
+			for (int n = -warmupTimes; n < CROSSOVERTIMES; n++) {
+				double startTime = GetWallTime();
+				err |= clEnqueueNDRangeKernel(queues[q], triadKernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+				err |= clFinish(queues[q]);
+				if (n >= 0) times[n] = GetWallTime() - startTime;
+			}
+			CheckOpenCLError(err, __LINE__);
+			GetTimeStatistics(times, CROSSOVERTIMES, &result);
+			if (crossover[q] == 0 && result.medianTime >= 2.0*emptyLatency[q]) crossover[q] = bytes;
+
+			double rate = 3.0*globalSize*vecWidth*elementSize/1024.0/1024.0/1024.0/result.medianTime;
+			if (q == 0) printf("   %11.2lf   %13.3lf", result.medianTime*1.0e6, rate);
+			else printf("   %15.2lf   %17.3lf", result.medianTime*1.0e6, rate);
+		}
+		printf("\n");
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (int q = 0; q < nQueues; q++) {
+		if (crossover[q] > 0) {
+			printf("Crossover on the %s queue: %.1lf KB arrays, where a triad takes twice an empty launch (%.2lf us)\n",
+			       queueNames[q], crossover[q]/1024.0, 2.0*emptyLatency[q]*1.0e6);
+		}
+		else {
+			printf("No crossover on the %s queue up to %.1lf KB arrays\n", queueNames[q], arraySize*elementSize/1024.0);
+		}
+	}
+
+	clReleaseKernel(emptyKernel);
+	clReleaseKernel(triadKernel);
+	for (int q = 0; q < nQueues; q++) {
+		clReleaseCommandQueue(queues[q]);
+	}
+	free(times);
+}
+
+
+
+// Event callback of the launch test: flag that the launch completed. It runs on a runtime thread, so the flag is
+// set atomically, and the host takes the time when it sees it.
+void CL_CALLBACK LaunchCallback(cl_event event, cl_int status, void *data)
+{
+	(void)event;
+	(void)status;
+	__atomic_store_n((int *)data, 1, __ATOMIC_RELEASE);
+}
+
+
+
+// Alignment sensitivity: copy and triad at each vector width on the arrays shifted by a number of bytes, from 0 up
+// to ALIGNCACHELINES cache lines (or the base address alignment, if larger) in steps of whole items. Sub-buffer
+// origins must be multiples of the base address alignment, so each shift is split into the largest such origin and
+// the items left over, which the offset kernels skip. Every shift processes the same number of items.
+void RunAlignmentTest(cl_device_id *device, cl_command_queue *queue, cl_program programs[], cl_mem *device_A,
+                      cl_mem *device_B, cl_mem *device_C, double scalar, size_t arraySize)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	const int offsetKernels[2] = {COPY, TRIAD};
+	cl_kernel kernels[2][NVECWIDTHS];
+	double alignedRate[2][NVECWIDTHS], worstRate[2][NVECWIDTHS];
+	cl_uint baseAlignBits, lineSize;
+	cl_int err;
+
+	clGetDeviceInfo(*device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(baseAlignBits), &baseAlignBits, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, sizeof(lineSize), &lineSize, NULL);
+	if (lineSize == 0) lineSize = DEFAULTCACHELINE;
+	const size_t baseAlign = baseAlignBits/8;
+	size_t maxShift = ALIGNCACHELINES*lineSize;
+	if (maxShift < baseAlign) maxShift = baseAlign;
+	size_t step = elementSize;
+	while (maxShift/step > ALIGNMAXOFFSETS) step *= 2;
+	const size_t nItems = (arraySize - maxShift/elementSize)/16*16;
+
+	for (int k = 0; k < 2; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			char kernelName[64];
+			snprintf(kernelName, sizeof(kernelName), "%sOffsetKernel", streamKernelInfo[offsetKernels[k]].name);
+			kernels[k][v] = clCreateKernel(programs[v], kernelName, &err);
+			CheckOpenCLError(err, __LINE__);
+		}
+	}
+
+	printf("Base address alignment: %zu B, cache line: %u B, shift step: %zu B, %.1lf MB arrays\n",
+	       baseAlign, lineSize, step, nItems*elementSize/1024.0/1024.0);
+	printf("Best Rate GB/s of copy and triad at each vector width, with the arrays shifted by Shift B: a sub-buffer at\n");
+	printf("Origin B, and the rest as an item offset in the kernel\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("   Shift B   Origin B");
+	for (int k = 0; k < 2; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			char name[16];
+			snprintf(name, sizeof(name), "%s%zu", streamKernelInfo[offsetKernels[k]].name, vecWidths[v]);
+			printf(" %9s", name);
+		}
+	}
+	printf("\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (size_t shift = 0; shift <= maxShift; shift += step) {
+		const size_t origin = shift/baseAlign*baseAlign;
+		const cl_ulong itemOffset = (shift - origin)/elementSize;
+		cl_buffer_region region = {origin, arraySize*elementSize - origin};
+		cl_mem sub_A = clCreateSubBuffer(*device_A, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		cl_mem sub_B = clCreateSubBuffer(*device_B, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		cl_mem sub_C = clCreateSubBuffer(*device_C, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+		CheckOpenCLError(err, __LINE__);
+
+		printf("%10zu   %8zu", shift, origin);
+		for (int k = 0; k < 2; k++) {
+			for (int v = 0; v < NVECWIDTHS; v++) {
+				cl_uint nArgs = SetStreamKernelArg(&kernels[k][v], offsetKernels[k], &sub_A, &sub_B, &sub_C, scalar);
+				err = clSetKernelArg(kernels[k][v], nArgs, sizeof(cl_ulong), &itemOffset);
+				CheckOpenCLError(err, __LINE__);
+
+				TestResult result;
+				TimeLocalSize(queue, &kernels[k][v], vecWidths[v], nItems, 0, NTIMES, 0, &result);
+				double rate = streamKernelInfo[offsetKernels[k]].memops*result.items*elementSize/1024.0/1024.0/1024.0
+				              /result.minTime;
+				if (shift == 0) alignedRate[k][v] = worstRate[k][v] = rate;
+				if (rate < worstRate[k][v]) worstRate[k][v] = rate;
+				printf(" %9.3lf", rate);
+			}
+		}
+		printf("\n");
+
+		clReleaseMemObject(sub_A);
+		clReleaseMemObject(sub_B);
+		clReleaseMemObject(sub_C);
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("%21s", "Worst % of shift 0");
+	for (int k = 0; k < 2; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			printf(" %8.1lf%%", worstRate[k][v]/alignedRate[k][v]*100.0);
+		}
+	}
+	printf("\n");
+
+	for (int k = 0; k < 2; k++) {
+		for (int v = 0; v < NVECWIDTHS; v++) {
+			clReleaseKernel(kernels[k][v]);
+		}
+	}
+}
+
+
+
+// Run the stream kernels at one vector width on arrays of each allocation flavour the device supports: device
+// buffers, CL_MEM_ALLOC_HOST_PTR buffers, CL_MEM_USE_HOST_PTR buffers over page-aligned host memory, and coarse-
+// and fine-grained SVM buffers as reported by CL_DEVICE_SVM_CAPABILITIES. The kernels get SVM arrays as SVM
+// pointers, and the verification reads them through CL_MEM_USE_HOST_PTR buffers over the same memory. Results
+// go in one table, a column per flavour. Returns EXIT_FAILURE if any flavour's results are wrong.
+int RunAllocationTest(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program programs[],
+                      double scalar, size_t arraySize, size_t vecWidth)
+{
+	const size_t sizeBytes = arraySize*elementTypes[elementType].size;
+	int supported[NALLOCS] = {1, 1, 1, 0, 0};
+	TestResult results[NALLOCS][NSTREAMKERNELS];
+	int status = EXIT_SUCCESS;
+	cl_int err;
+
+	int v = 0;
+	while (vecWidths[v] != vecWidth) v++;
+
+#ifdef CL_VERSION_2_0
+	// Devices before OpenCL 2.0 don't know the query, and have no SVM
+	cl_device_svm_capabilities svmCaps;
+	if (clGetDeviceInfo(*device, CL_DEVICE_SVM_CAPABILITIES, sizeof(svmCaps), &svmCaps, NULL) != CL_SUCCESS) svmCaps = 0;
+	supported[ALLOC_SVMCOARSE] = (svmCaps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER) != 0;
+	supported[ALLOC_SVMFINE] = (svmCaps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0;
+	printf("SVM capabilities: coarse-grain buffer %s, fine-grain buffer %s, fine-grain system %s, atomics %s\n",
+	       svmCaps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER ? "yes" : "no", svmCaps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER ? "yes" : "no",
+	       svmCaps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM ? "yes" : "no", svmCaps & CL_DEVICE_SVM_ATOMICS ? "yes" : "no");
+#else
+	(void)device;
+	printf("Built with OpenCL 1.x headers, SVM not tested\n");
+#endif
+
+	for (int a = 0; a < NALLOCS; a++) {
+		if (!supported[a]) continue;
+		cl_mem arrays[3] = {NULL, NULL, NULL};
+		void *host[3] = {NULL, NULL, NULL};
+		const int svm = (a == ALLOC_SVMCOARSE || a == ALLOC_SVMFINE);
+
+		for (int i = 0; i < 3; i++) {
+			switch (a) {
+				case ALLOC_BUFFER:
+					arrays[i] = clCreateBuffer(*context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
+					break;
+				case ALLOC_ALLOCHOSTPTR:
+					arrays[i] = clCreateBuffer(*context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeBytes, NULL, &err);
+					break;
+				case ALLOC_USEHOSTPTR:
+					if (posix_memalign(&host[i], HOSTPTRALIGN, sizeBytes) != 0) {
+						printf("Error allocating aligned host memory, line %d\n", __LINE__);
+						ReleaseAllocArrays(context, arrays, host, svm);
+						return EXIT_FAILURE;
+					}
+					arrays[i] = clCreateBuffer(*context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeBytes, host[i], &err);
+					break;
+#ifdef CL_VERSION_2_0
+				case ALLOC_SVMCOARSE:
+				case ALLOC_SVMFINE:
+					host[i] = clSVMAlloc(*context, CL_MEM_READ_WRITE | (a == ALLOC_SVMFINE ? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0),
+					                     sizeBytes, 0);
+					if (host[i] == NULL) {
+						printf("Error allocating %s arrays, line %d\n", allocNames[a], __LINE__);
+						ReleaseAllocArrays(context, arrays, host, svm);
+						return EXIT_FAILURE;
+					}
+					arrays[i] = clCreateBuffer(*context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeBytes, host[i], &err);
+					break;
+#endif
+			}
+			CheckOpenCLError(err, __LINE__);
+		}
+
+		cl_kernel initialiseArraysKernel = clCreateKernel(programs[0], "initialiseArraysKernel", &err);
+		CheckOpenCLError(err, __LINE__);
+		cl_kernel kernels[NSTREAMKERNELS];
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			char kernelName[64];
+			snprintf(kernelName, sizeof(kernelName), "%sKernel", streamKernelInfo[k].name);
+			kernels[k] = clCreateKernel(programs[v], kernelName, &err);
+			CheckOpenCLError(err, __LINE__);
+		}
+		err = CL_SUCCESS;
+		for (int i = 0; i < 3; i++) {
+#ifdef CL_VERSION_2_0
+			if (svm) {
+				err |= clSetKernelArgSVMPointer(initialiseArraysKernel, i, host[i]);
+				continue;
+			}
+#endif
+			err |= clSetKernelArg(initialiseArraysKernel, i, sizeof(cl_mem), &arrays[i]);
+		}
+		CheckOpenCLError(err, __LINE__);
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+#ifdef CL_VERSION_2_0
+			if (svm) {
+				SetStreamKernelArgSVM(&kernels[k], k, host[0], host[1], host[2], scalar);
+				continue;
+			}
+#endif
+			SetStreamKernelArg(&kernels[k], k, &arrays[0], &arrays[1], &arrays[2], scalar);
+		}
+
+		size_t initGlobalSize = arraySize;
+		err = clEnqueueNDRangeKernel(*queue, initialiseArraysKernel, 1, NULL, &initGlobalSize, NULL, 0, NULL, NULL);
+		clFinish(*queue);
+		CheckOpenCLError(err, __LINE__);
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			RunTest(queue, &kernels[k], vecWidth, arraySize, 0, &results[a][k]);
+		}
+		printf("%s arrays: ", allocNames[a]);
+		if (VerifyResults(context, &programs[0], queue, &arrays[0], &arrays[1], &arrays[2], scalar, arraySize) != EXIT_SUCCESS) {
+			status = EXIT_FAILURE;
+		}
+
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			clReleaseKernel(kernels[k]);
+		}
+		clReleaseKernel(initialiseArraysKernel);
+		ReleaseAllocArrays(context, arrays, host, svm);
+	}
+
+	// Best rate of each kernel, a column per flavour
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function     ");
+	for (int a = 0; a < NALLOCS; a++) {
+		printf("   %s GB/s", allocNames[a]);
+	}
+	printf("\n-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		char testName[64];
+		snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+		printf("%13s", testName);
+		for (int a = 0; a < NALLOCS; a++) {
+			int width = strlen(allocNames[a]) + 5;
+			if (supported[a]) {
+				printf("   %*.3lf", width, streamKernelInfo[k].memops*results[a][k].items*elementTypes[elementType].size
+				       /1024.0/1024.0/1024.0/results[a][k].minTime);
+			}
+			else {
+				printf("   %*s", width, "-");
+			}
+		}
+		printf("\n");
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	return status;
+}
+
+
+
+// Release the arrays of one allocation flavour, and free their host memory with clSVMFree or free as it was
+// allocated. Arrays and host pointers not yet allocated are NULL.
+void ReleaseAllocArrays(cl_context *context, cl_mem *arrays, void **host, int svm)
+{
+	for (int i = 0; i < 3; i++) {
+		if (arrays[i] != NULL) clReleaseMemObject(arrays[i]);
+		if (host[i] == NULL) continue;
+#ifdef CL_VERSION_2_0
+		if (svm) {
+			clSVMFree(*context, host[i]);
+			continue;
+		}
+#else
+		(void)context;
+		(void)svm;
+#endif
+		free(host[i]);
+	}
+}
+
+
+
+// Run the stream kernels at the same time on several command queues of one device, each working on a
+// disjoint part of the arrays through sub-buffers. The last part also takes the items left over by the
+// alignment of the others, so together they cover the whole arrays. The queue count goes up in powers of two to nQueues, so
+// the single queue rate is printed alongside. Per-queue bandwidth is from that queue's first kernel start to
+// last kernel end, and the aggregate from the first start to the last end over all queues. The local size
+// is left to the runtime.
+void RunConcurrentTest(cl_device_id *device, cl_context *context, cl_program *program, cl_mem *device_A, cl_mem *device_B,
+                       cl_mem *device_C, double scalar, size_t arraySize, size_t vecWidth, int nQueues)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	cl_command_queue queues[MAXQUEUES];
+	cl_mem sub_A[MAXQUEUES], sub_B[MAXQUEUES], sub_C[MAXQUEUES];
+	cl_kernel kernels[MAXQUEUES];
+	size_t globalSizes[MAXQUEUES];
+	cl_event *events = malloc(MAXQUEUES*NTIMES*sizeof(cl_event));
+	cl_int err;
+
+	// Sub-buffer origins must be aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN (in bits), and each part must
+	// be a whole number of vectors
+	cl_uint baseAddrAlign;
+	clGetDeviceInfo(*device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(baseAddrAlign), &baseAddrAlign, NULL);
+	size_t alignItems = baseAddrAlign/8/elementSize;
+	if (alignItems < 16) alignItems = 16;
+
+	for (int q = 0; q < nQueues; q++) {
+		queues[q] = clCreateCommandQueue(*context, *device, CL_QUEUE_PROFILING_ENABLE, &err);
+		CheckOpenCLError(err, __LINE__);
+	}
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function        Queues   Aggregate GB/s   Min Queue GB/s   Avg Queue GB/s   Max Queue GB/s\n");
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (int nq = 1; nq <= nQueues; nq = (nq*2 > nQueues && nq != nQueues) ? nQueues : nq*2) {
+			size_t partSize = (arraySize/nq/alignItems)*alignItems;
+
+			for (int q = 0; q < nq; q++) {
+				size_t items = (q == nq - 1) ? arraySize - q*partSize : partSize;
+				cl_buffer_region region = {q*partSize*elementSize, items*elementSize};
+				globalSizes[q] = items/vecWidth;
+				sub_A[q] = clCreateSubBuffer(*device_A, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+				CheckOpenCLError(err, __LINE__);
+				sub_B[q] = clCreateSubBuffer(*device_B, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+				CheckOpenCLError(err, __LINE__);
+				sub_C[q] = clCreateSubBuffer(*device_C, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+				CheckOpenCLError(err, __LINE__);
+
+				// Kernel arguments can't differ between queues, so each queue has its own kernel object
+				char kernelName[64];
+				snprintf(kernelName, sizeof(kernelName), "%sKernel", streamKernelInfo[k].name);
+				kernels[q] = clCreateKernel(*program, kernelName, &err);
+				CheckOpenCLError(err, __LINE__);
+				SetStreamKernelArg(&kernels[q], k, &sub_A[q], &sub_B[q], &sub_C[q], scalar);
+				err = SetItemCountArg(&kernels[q], globalSizes[q]);
+				CheckOpenCLError(err, __LINE__);
+			}
+
+			// Enqueue round-robin over the queues, so they all have work before any is flushed
+			err = CL_SUCCESS;
+			for (int n = 0; n < NTIMES; n++) {
+				for (int q = 0; q < nq; q++) {
+					err |= clEnqueueNDRangeKernel(queues[q], kernels[q], 1, NULL, &globalSizes[q], NULL, 0, NULL,
+					                              &events[q*NTIMES + n]);
+				}
+			}
+			for (int q = 0; q < nq; q++) clFlush(queues[q]);
+			for (int q = 0; q < nq; q++) clFinish(queues[q]);
+			CheckOpenCLError(err, __LINE__);
+
+			double bytesPerItem = (double)NTIMES*streamKernelInfo[k].memops*elementSize;
+			double minRate = DBL_MAX, maxRate = 0.0, totalRate = 0.0;
+			cl_ulong firstStart = ~(cl_ulong)0, lastEnd = 0;
+			for (int q = 0; q < nq; q++) {
+				cl_ulong start = ~(cl_ulong)0, end = 0;
+				for (int n = 0; n < NTIMES; n++) {
+					cl_ulong t = GetEventTimestamp(events[q*NTIMES + n], CL_PROFILING_COMMAND_START);
+					if (t < start) start = t;
+					t = GetEventTimestamp(events[q*NTIMES + n], CL_PROFILING_COMMAND_END);
+					if (t > end) end = t;
+					clReleaseEvent(events[q*NTIMES + n]);
+				}
+				double rate = bytesPerItem*globalSizes[q]*vecWidth/1024.0/1024.0/1024.0/(1e-9*(end - start));
+				if (rate < minRate) minRate = rate;
+				if (rate > maxRate) maxRate = rate;
+				totalRate += rate;
+				if (start < firstStart) firstStart = start;
+				if (end > lastEnd) lastEnd = end;
+
+				clReleaseKernel(kernels[q]);
+				clReleaseMemObject(sub_A[q]);
+				clReleaseMemObject(sub_B[q]);
+				clReleaseMemObject(sub_C[q]);
+			}
+
+			char testName[64];
+			snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+			printf("%13s   %6d   %14.3lf   %14.3lf   %14.3lf   %14.3lf\n", testName, nq,
+			       bytesPerItem*arraySize/1024.0/1024.0/1024.0/(1e-9*(lastEnd - firstStart)), minRate, totalRate/nq, maxRate);
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	for (int q = 0; q < nQueues; q++) {
+		clReleaseCommandQueue(queues[q]);
+	}
+	free(events);
+}
+
+
+
+// Run the stream kernels on several devices at once, one host thread and queue per device. devices is "all", or
+// a comma separated list of platform:device indices as printed at start up. Each device gets its own context,
+// program and arrays. The threads wait for each other before each kernel, and the aggregate bandwidth is the
+// total data moved from the first thread starting to the last finishing, by host wall time.
+int RunMultiDeviceTest(char *devices, size_t vecWidth)
+{
+	DeviceThread threads[MAXDEVICES];
+	int nThreads = 0;
+	cl_uint numPlatforms;
+	cl_platform_id *platforms;
+	cl_int err;
+
+	err = clGetPlatformIDs(0, NULL, &numPlatforms);
+	CheckOpenCLError(err, __LINE__);
+	platforms = calloc(numPlatforms, sizeof(cl_platform_id));
+	clGetPlatformIDs(numPlatforms, platforms, NULL);
+
+	for (cl_uint i = 0; i < numPlatforms; i++) {
+		cl_uint numDevices;
+		if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices) != CL_SUCCESS) continue;
+		cl_device_id *deviceIDs = malloc(numDevices*sizeof(cl_device_id));
+		clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, numDevices, deviceIDs, NULL);
+
+		for (cl_uint j = 0; j < numDevices && nThreads < MAXDEVICES; j++) {
+			char index[32];
+			snprintf(index, sizeof(index), "%u:%u", i, j);
+
+			// Match whole entries of the comma separated list
+			int selected = (strcmp(devices, "all") == 0);
+			char *list = strdup(devices);
+			for (char *entry = strtok(list, ","); entry != NULL && !selected; entry = strtok(NULL, ",")) {
+				selected = (strcmp(entry, index) == 0);
+			}
+			free(list);
+
+			if (selected) {
+				memset(&threads[nThreads], 0, sizeof(DeviceThread));
+				threads[nThreads].device = deviceIDs[j];
+				threads[nThreads].vecWidth = vecWidth;
+				threads[nThreads].nShares = 1;
+				clGetDeviceInfo(deviceIDs[j], CL_DEVICE_NAME, sizeof(threads[nThreads].name), threads[nThreads].name, NULL);
+				printf("Using device %s: %s\n", index, threads[nThreads].name);
+				nThreads++;
+			}
+		}
+		free(deviceIDs);
+	}
+	free(platforms);
+
+	if (nThreads == 0) {
+		printf("No devices selected by \"%s\"\n", devices);
+		return EXIT_FAILURE;
+	}
+
+	RunDeviceThreads(threads, nThreads);
+
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function        Device                                        Array size MB   Rate GB/s\n");
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		char testName[64];
+		double totalBytes = 0.0, firstStart = DBL_MAX, lastEnd = 0.0;
+		snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (int t = 0; t < nThreads; t++) {
+			if (!threads[t].ok) {
+				printf("%13s   %-44.44s   %13s   %9s\n", testName, threads[t].name, "-", "failed");
+				continue;
+			}
+			double bytes = (double)NTIMES*streamKernelInfo[k].memops*threads[t].arraySize*elementTypes[elementType].size;
+			totalBytes += bytes;
+			if (threads[t].startTime[k] < firstStart) firstStart = threads[t].startTime[k];
+			if (threads[t].endTime[k] > lastEnd) lastEnd = threads[t].endTime[k];
+			printf("%13s   %-44.44s   %13zu   %9.3lf\n", testName, threads[t].name,
+			       threads[t].arraySize*elementTypes[elementType].size/1024/1024,
+			       bytes/1024.0/1024.0/1024.0/(threads[t].endTime[k] - threads[t].startTime[k]));
+		}
+		if (totalBytes > 0.0) {
+			printf("%13s   %-44s   %13s   %9.3lf\n", testName, "Aggregate", "",
+			       totalBytes/1024.0/1024.0/1024.0/(lastEnd - firstStart));
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	return EXIT_SUCCESS;
+}
+
+
+
+// Run the kernels on each device of threads at the same time, one host thread each
+void RunDeviceThreads(DeviceThread *threads, int nThreads)
+{
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, nThreads);
+	for (int t = 0; t < nThreads; t++) {
+		threads[t].barrier = &barrier;
+		pthread_create(&threads[t].thread, NULL, MultiDeviceThread, &threads[t]);
+	}
+	for (int t = 0; t < nThreads; t++) {
+		pthread_join(threads[t].thread, NULL);
+	}
+	pthread_barrier_destroy(&barrier);
+}
+
+
+
+// Host thread of the multi-device test. Sets up the device, then runs each kernel NTIMES between barriers.
+// A device that fails to set up still waits at every barrier, so the other threads are not held up.
+void *MultiDeviceThread(void *arg)
+{
+	DeviceThread *dt = arg;
+	const size_t elementSize = elementTypes[elementType].size;
+	const double scalar = 3.0;
+	cl_context context = NULL;
+	cl_command_queue queue = NULL;
+	cl_program program = NULL;
+	cl_kernel initialiseArraysKernel = NULL;
+	cl_kernel kernels[NSTREAMKERNELS];
+	cl_mem device_A = NULL, device_B = NULL, device_C = NULL;
+	cl_ulong maxAlloc, globalMemSize;
+	cl_int err;
+
+	dt->ok = (elementTypes[elementType].extension == NULL || DeviceHasExtension(&dt->device, elementTypes[elementType].extension));
+	if (!dt->ok) {
+		printf("%s does not support %s\n", dt->name, elementTypes[elementType].name);
+	}
+	if (dt->ok) {
+		context = clCreateContext(NULL, 1, &dt->device, NULL, NULL, &err);
+		CheckOpenCLError(err, __LINE__);
+		queue = clCreateCommandQueue(context, dt->device, 0, &err);
+		CheckOpenCLError(err, __LINE__);
+		dt->ok = (BuildProgram(&context, &dt->device, dt->vecWidth, &program) == EXIT_SUCCESS);
+	}
+	if (dt->ok) {
+		clGetDeviceInfo(dt->device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, NULL);
+		clGetDeviceInfo(dt->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, NULL);
+		dt->arraySize = GetArraySize(TRYARRAYBYTES, maxAlloc, globalMemSize/dt->nShares);
+		device_A = clCreateBuffer(context, CL_MEM_READ_WRITE, dt->arraySize*elementSize, NULL, &err);
+		device_B = clCreateBuffer(context, CL_MEM_READ_WRITE, dt->arraySize*elementSize, NULL, &err);
+		device_C = clCreateBuffer(context, CL_MEM_READ_WRITE, dt->arraySize*elementSize, NULL, &err);
+		CheckOpenCLError(err, __LINE__);
+
+		initialiseArraysKernel = clCreateKernel(program, "initialiseArraysKernel", &err);
+		err |= clSetKernelArg(initialiseArraysKernel, 0, sizeof(cl_mem), &device_A);
+		err |= clSetKernelArg(initialiseArraysKernel, 1, sizeof(cl_mem), &device_B);
+		err |= clSetKernelArg(initialiseArraysKernel, 2, sizeof(cl_mem), &device_C);
+		CheckOpenCLError(err, __LINE__);
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			char kernelName[64];
+			snprintf(kernelName, sizeof(kernelName), "%sKernel", streamKernelInfo[k].name);
+			kernels[k] = clCreateKernel(program, kernelName, &err);
+			CheckOpenCLError(err, __LINE__);
+			SetStreamKernelArg(&kernels[k], k, &device_A, &device_B, &device_C, scalar);
+			err = SetItemCountArg(&kernels[k], dt->arraySize/dt->vecWidth);
+			CheckOpenCLError(err, __LINE__);
+		}
+
+		size_t initGlobalSize = dt->arraySize;
+		err = clEnqueueNDRangeKernel(queue, initialiseArraysKernel, 1, NULL, &initGlobalSize, NULL, 0, NULL, NULL);
+		clFinish(queue);
+		CheckOpenCLError(err, __LINE__);
+	}
+
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		pthread_barrier_wait(dt->barrier);
+		if (!dt->ok) continue;
+
+		size_t globalSize = dt->arraySize/dt->vecWidth;
+		err = CL_SUCCESS;
+		dt->startTime[k] = GetWallTime();
+		for (int n = 0; n < NTIMES; n++) {
+			err |= clEnqueueNDRangeKernel(queue, kernels[k], 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+		}
+		clFinish(queue);
+		dt->endTime[k] = GetWallTime();
+		CheckOpenCLError(err, __LINE__);
+	}
+
+	if (dt->ok) {
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			clReleaseKernel(kernels[k]);
+		}
+		clReleaseKernel(initialiseArraysKernel);
+		clReleaseMemObject(device_A);
+		clReleaseMemObject(device_B);
+		clReleaseMemObject(device_C);
+	}
+	if (program != NULL) clReleaseProgram(program);
+	if (queue != NULL) clReleaseCommandQueue(queue);
+	if (context != NULL) clReleaseContext(context);
+	return NULL;
+}
+
+
+
+// Rate in GB/s of a device thread's NTIMES launches of kernel k
+double DeviceThreadRate(DeviceThread *dt, int k)
+{
+	double bytes = (double)NTIMES*streamKernelInfo[k].memops*dt->arraySize*elementTypes[elementType].size;
+	return bytes/1024.0/1024.0/1024.0/(dt->endTime[k] - dt->startTime[k]);
+}
+
+
+
+// Device fission. Compute unit scaling runs the kernels on one sub-device of 1, 2, 4, ... compute units at a time,
+// partitioned by counts (or equally, taking the first sub-device, if the device can't partition by counts). Then
+// the device is split by affinity domain (NUMA nodes where it has them) and equally in two, and the kernels run on
+// each sub-device alone and then on all of them at once, so remote memory and shared bandwidth show up as an
+// aggregate below the sum of the parts. Each sub-device is set up and run by the multi-device test's thread, with
+// the arrays sized to its share of the memory. Returns EXIT_FAILURE if the device can't be partitioned at all.
+int RunFissionTest(cl_device_id *device, size_t vecWidth)
+{
+	const char * const domainNames[6] = {"NUMA node", "L4 cache", "L3 cache", "L2 cache", "L1 cache", "next partitionable"};
+	cl_uint computeUnits = 0, maxSubDevices = 0;
+	cl_device_partition_property partitionTypes[8];
+	cl_device_affinity_domain domains = 0;
+	size_t partitionTypesSize = 0;
+	int byCounts = 0, equally = 0, byDomain = 0;
+	cl_int err;
+
+	clGetDeviceInfo(*device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_PARTITION_MAX_SUB_DEVICES, sizeof(maxSubDevices), &maxSubDevices, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_PARTITION_PROPERTIES, sizeof(partitionTypes), partitionTypes, &partitionTypesSize);
+	clGetDeviceInfo(*device, CL_DEVICE_PARTITION_AFFINITY_DOMAIN, sizeof(domains), &domains, NULL);
+	for (size_t i = 0; i < partitionTypesSize/sizeof(cl_device_partition_property); i++) {
+		if (partitionTypes[i] == CL_DEVICE_PARTITION_BY_COUNTS) byCounts = 1;
+		if (partitionTypes[i] == CL_DEVICE_PARTITION_EQUALLY) equally = 1;
+		if (partitionTypes[i] == CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN && domains != 0) byDomain = 1;
+	}
+	printf("Device has %u compute units, and partitions into up to %u sub-devices:%s%s%s\n", computeUnits, maxSubDevices,
+	       equally ? " equally" : "", byCounts ? " by counts" : "", byDomain ? " by affinity domain" : "");
+	if (maxSubDevices < 2 || !(byCounts || equally || byDomain)) {
+		printf("PARTITIONING NOT SUPPORTED: the driver can't split this device into sub-devices\n");
+		return EXIT_FAILURE;
+	}
+
+	// Compute unit scaling
+	if (byCounts || equally) {
+		double firstTriad = 0.0;
+		printf("\nCompute unit scaling, one sub-device (partitioned %s) at a time, vector width %zu\n",
+		       byCounts ? "by counts" : "equally", vecWidth);
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("  CUs    Copy GB/s   Scale GB/s     Add GB/s   Triad GB/s   Triad GB/s per CU   Triad speedup\n");
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		for (cl_uint n = 1; n <= computeUnits; n = (n < computeUnits && 2*n > computeUnits) ? computeUnits : 2*n) {
+			cl_device_partition_property properties[4] = {CL_DEVICE_PARTITION_BY_COUNTS, n, CL_DEVICE_PARTITION_BY_COUNTS_LIST_END, 0};
+			if (!byCounts) {
+				properties[0] = CL_DEVICE_PARTITION_EQUALLY;
+				properties[2] = 0;
+			}
+			cl_device_id *subDevices;
+			cl_uint nSubDevices;
+			err = CreateSubDevices(device, properties, &subDevices, &nSubDevices);
+			if (err != CL_SUCCESS) {
+				printf("%5u   partitioning failed (error %d)\n", n, err);
+				continue;
+			}
+
+			DeviceThread thread;
+			memset(&thread, 0, sizeof(DeviceThread));
+			thread.device = subDevices[0];
+			thread.vecWidth = vecWidth;
+			thread.nShares = 1;
+			snprintf(thread.name, sizeof(thread.name), "Sub-device of %u compute units", n);
+			RunDeviceThreads(&thread, 1);
+			ReleaseSubDevices(subDevices, nSubDevices);
+			if (!thread.ok) {
+				printf("%5u   failed\n", n);
+				continue;
+			}
+
+			printf("%5u", n);
+			for (int k = 0; k < NSTREAMKERNELS; k++) {
+				printf("   %10.3lf", DeviceThreadRate(&thread, k));
+			}
+			double triad = DeviceThreadRate(&thread, TRIAD);
+			if (firstTriad == 0.0) firstTriad = triad;
+			printf("   %17.3lf   %13.2lf\n", triad/n, triad/firstTriad);
+		}
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	}
+
+	// Each sub-device alone, then all at once: by affinity domain, then in two halves. Halves of an odd number of
+	// compute units need counts; partitioning equally makes as many sub-devices of computeUnits/2 as fit, so it
+	// is named by how many that is.
+	for (int scheme = 0; scheme < 2; scheme++) {
+		cl_device_partition_property properties[5] = {0, 0, 0, 0, 0};
+		char schemeName[64];
+		if (scheme == 0) {
+			if (!byDomain) continue;
+			cl_device_affinity_domain domain = domains & -domains;
+			if (domains & CL_DEVICE_AFFINITY_DOMAIN_NUMA) domain = CL_DEVICE_AFFINITY_DOMAIN_NUMA;
+			else if (domains & CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE) domain = CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE;
+			properties[0] = CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN;
+			properties[1] = domain;
+			int d = 0;
+			while ((domain >> d) != 1) d++;
+			snprintf(schemeName, sizeof(schemeName), "by affinity domain, one sub-device per %s", domainNames[d]);
+		}
+		else if (byCounts && computeUnits >= 2) {
+			properties[0] = CL_DEVICE_PARTITION_BY_COUNTS;
+			properties[1] = computeUnits/2;
+			properties[2] = computeUnits - computeUnits/2;
+			properties[3] = CL_DEVICE_PARTITION_BY_COUNTS_LIST_END;
+			snprintf(schemeName, sizeof(schemeName), "in two by counts, %u and %u compute units", computeUnits/2,
+			         computeUnits - computeUnits/2);
+		}
+		else {
+			if (!equally || computeUnits < 2) continue;
+			properties[0] = CL_DEVICE_PARTITION_EQUALLY;
+			properties[1] = computeUnits/2;
+			snprintf(schemeName, sizeof(schemeName), "equally in %u, %u compute units each", computeUnits/(computeUnits/2),
+			         computeUnits/2);
+		}
+
+		cl_device_id *subDevices;
+		cl_uint nSubDevices;
+		err = CreateSubDevices(device, properties, &subDevices, &nSubDevices);
+		if (err != CL_SUCCESS) {
+			printf("\nPartitioning %s failed (error %d)\n", schemeName, err);
+			continue;
+		}
+		int nThreads = nSubDevices < MAXDEVICES ? nSubDevices : MAXDEVICES;
+		printf("\nPartitioned %s: %u sub-devices", schemeName, nSubDevices);
+		if (nThreads < (int)nSubDevices) printf(", running the first %d", nThreads);
+		printf("\n");
+
+		DeviceThread threads[MAXDEVICES];
+		double alone[MAXDEVICES][NSTREAMKERNELS];
+		cl_uint subUnits[MAXDEVICES];
+		for (int t = 0; t < nThreads; t++) {
+			memset(&threads[t], 0, sizeof(DeviceThread));
+			threads[t].device = subDevices[t];
+			threads[t].vecWidth = vecWidth;
+			threads[t].nShares = nThreads;
+			snprintf(threads[t].name, sizeof(threads[t].name), "Sub-device %d", t);
+			clGetDeviceInfo(subDevices[t], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(subUnits[t]), &subUnits[t], NULL);
+		}
+		for (int t = 0; t < nThreads; t++) {
+			RunDeviceThreads(&threads[t], 1);
+			for (int k = 0; k < NSTREAMKERNELS; k++) {
+				alone[t][k] = threads[t].ok ? DeviceThreadRate(&threads[t], k) : 0.0;
+			}
+		}
+		RunDeviceThreads(threads, nThreads);
+
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("Function        Sub-device     CUs   Alone GB/s   Together GB/s   Together/Alone\n");
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			char testName[64];
+			double sumAlone = 0.0, totalBytes = 0.0, firstStart = DBL_MAX, lastEnd = 0.0;
+			snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+
+			printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+			for (int t = 0; t < nThreads; t++) {
+				if (!threads[t].ok || alone[t][k] == 0.0) {
+					printf("%13s   %10d   %5u   %10s   %13s   %14s\n", testName, t, subUnits[t], "-", "-", "failed");
+					continue;
+				}
+				double together = DeviceThreadRate(&threads[t], k);
+				sumAlone += alone[t][k];
+				totalBytes += (double)NTIMES*streamKernelInfo[k].memops*threads[t].arraySize*elementTypes[elementType].size;
+				if (threads[t].startTime[k] < firstStart) firstStart = threads[t].startTime[k];
+				if (threads[t].endTime[k] > lastEnd) lastEnd = threads[t].endTime[k];
+				printf("%13s   %10d   %5u   %10.3lf   %13.3lf   %14.3lf\n", testName, t, subUnits[t], alone[t][k], together,
+				       together/alone[t][k]);
+			}
+			if (totalBytes > 0.0) {
+				double aggregate = totalBytes/1024.0/1024.0/1024.0/(lastEnd - firstStart);
+				printf("%13s   %10s   %5s   %10.3lf   %13.3lf   %14.3lf\n", testName, "All", "", sumAlone, aggregate,
+				       aggregate/sumAlone);
+			}
+		}
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+		ReleaseSubDevices(subDevices, nSubDevices);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+
+// Partition a device with clCreateSubDevices. On success *subDevices is a list of *nSubDevices sub-devices, to be
+// released with ReleaseSubDevices.
+cl_int CreateSubDevices(cl_device_id *device, const cl_device_partition_property *properties, cl_device_id **subDevices,
+                        cl_uint *nSubDevices)
+{
+	cl_int err = clCreateSubDevices(*device, properties, 0, NULL, nSubDevices);
+	if (err != CL_SUCCESS) return err;
+	if (*nSubDevices == 0) return CL_DEVICE_PARTITION_FAILED;
+
+	*subDevices = malloc(*nSubDevices*sizeof(cl_device_id));
+	err = clCreateSubDevices(*device, properties, *nSubDevices, *subDevices, NULL);
+	if (err != CL_SUCCESS) free(*subDevices);
+	return err;
+}
+
+
+
+void ReleaseSubDevices(cl_device_id *subDevices, cl_uint nSubDevices)
+{
+	for (cl_uint i = 0; i < nSubDevices; i++) {
+		clReleaseDevice(subDevices[i]);
+	}
+	free(subDevices);
+}
+
+
+
+// Monitoring mode. The context, programs and arrays stay alive, and every monitorInterval seconds a sample times
+// MONITORLAUNCHES triad launches at the -w vector width and a single chain pointer chase through a list in its own
+// buffer. If a sample takes more than monitorDutyCycle of the interval, the next one waits longer. Each sample is
+// printed, appended to the JSON lines file and written to the Prometheus text file. Samples below the rolling
+// baseline by more than monitorDropThreshold are low, and are kept out of the baseline, so that a sustained drop
+// (MONITORSUSTAIN low samples in a row) is reported against the rate before it. Runs until monitorSamples samples
+// are taken, or SIGINT or SIGTERM. Returns EXIT_FAILURE if the output files can't be written.
+int RunMonitor(cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_program programs[],
+               cl_kernel streamKernels[][NVECWIDTHS], size_t arraySize, size_t vecWidth)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	char deviceName[128], testName[64], tuningKey[1024], timestamp[64];
+	double window[MONITORWINDOW];
+	int nWindow = 0, nextWindow = 0, nLow = 0;
+	long nSamples = 0, nDrops = 0;
+	MonitorSample sample = {0};
+	TestResult result;
+	size_t localSize;
+	cl_int err;
+
+	int v = 0;
+	while (vecWidths[v] != vecWidth) v++;
+	cl_kernel *triadKernel = &streamKernels[TRIAD][v];
+	clGetDeviceInfo(*device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+
+	// Triad runs at its tuned work-group size, found now if the tuning file doesn't have it
+	snprintf(testName, sizeof(testName), "triadKernel%zu", vecWidth);
+	GetTuningKey(device, testName, arraySize, tuningKey, sizeof(tuningKey));
+	if (!LookupTuning(tuningKey, &localSize) || localSize > arraySize/vecWidth) {
+		RunTest(queue, triadKernel, vecWidth, arraySize, 0, &result);
+		localSize = result.bestLocalSize;
+		SaveTuning(tuningKey, localSize);
+	}
+
+	// The latency list is as large as one of the arrays, up to MONITORCHASEBYTES
+	size_t chaseBytes = arraySize*elementSize < MONITORCHASEBYTES ? arraySize*elementSize : MONITORCHASEBYTES;
+	const cl_ulong chaseItems = chaseBytes/sizeof(cl_uint);
+	const cl_ulong nLoads = CHASELOADS;
+	const cl_uint seed = PATTERNSEED;
+	cl_mem chaseList = clCreateBuffer(*context, CL_MEM_READ_WRITE, chaseItems*sizeof(cl_uint), NULL, &err);
+	cl_mem chaseSink = clCreateBuffer(*context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel chaseInitKernel = clCreateKernel(programs[0], "chaseInitKernel", &err);
+	cl_kernel chaseKernel = clCreateKernel(programs[0], "chaseKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	err  = clSetKernelArg(chaseInitKernel, 0, sizeof(cl_mem), &chaseList);
+	err |= clSetKernelArg(chaseInitKernel, 3, sizeof(cl_uint), &seed);
+	err |= clSetKernelArg(chaseKernel, 0, sizeof(cl_mem), &chaseList);
+	err |= clSetKernelArg(chaseKernel, 2, sizeof(cl_ulong), &nLoads);
+	err |= clSetKernelArg(chaseKernel, 3, sizeof(cl_mem), &chaseSink);
+	CheckOpenCLError(err, __LINE__);
+	BuildChaseList(queue, &chaseInitKernel, chaseItems);
+
+	FILE *jsonFile = fopen(monitorJsonFile, "a");
+	if (jsonFile == NULL) {
+		printf("Can't open %s: %s\n", monitorJsonFile, strerror(errno));
+		clReleaseKernel(chaseInitKernel);
+		clReleaseKernel(chaseKernel);
+		clReleaseMemObject(chaseList);
+		clReleaseMemObject(chaseSink);
+		return EXIT_FAILURE;
+	}
+	signal(SIGINT, MonitorSignal);
+	signal(SIGTERM, MonitorSignal);
+
+	char localSizeString[32];
+	FormatLocalSize(localSize, localSizeString, sizeof(localSizeString));
+	printf("Monitoring %s: triad%zu at work-group size %s on %.1lf MB arrays, latency over %.1lf MB, every %.1lf s\n",
+	       deviceName, vecWidth, localSizeString, arraySize*elementSize/1024.0/1024.0, chaseBytes/1024.0/1024.0,
+	       monitorInterval);
+	printf("Samples go to %s and %s. A drop is %d samples in a row %.0lf%% below the baseline.\n", monitorJsonFile,
+	       monitorPromFile, MONITORSUSTAIN, monitorDropThreshold*100.0);
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Time (UTC)                    Sample   Triad GB/s    Best GB/s   Latency ns   Baseline GB/s   Status\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	fflush(stdout);
+
+	int status = EXIT_SUCCESS;
+	while (!monitorStop && (monitorSamples == 0 || nSamples < monitorSamples)) {
+		sample.time = GetWallTime();
+		TimeLocalSize(queue, triadKernel, vecWidth, arraySize, localSize, MONITORLAUNCHES, 0, &result);
+		double bytes = 3.0*result.items*elementSize/1024.0/1024.0/1024.0;
+		sample.rate = bytes/result.medianTime;
+		sample.bestRate = bytes/result.minTime;
+		sample.latency = ChaseTime(queue, &chaseKernel, chaseItems, 1)/nLoads*1.0e9;
+		double sampleTime = GetWallTime() - sample.time;
+		nSamples++;
+
+		// Median of the baseline window
+		sample.baseline = 0.0;
+		if (nWindow >= MONITORMINBASELINE) {
+			double sorted[MONITORWINDOW];
+			memcpy(sorted, window, nWindow*sizeof(double));
+			qsort(sorted, nWindow, sizeof(double), CompareDoubles);
+			sample.baseline = nWindow % 2 ? sorted[nWindow/2] : 0.5*(sorted[nWindow/2 - 1] + sorted[nWindow/2]);
+		}
+
+		// Low samples stay out of the baseline. The first sample that isn't low ends a drop.
+		int recovered = 0;
+		sample.low = (sample.baseline > 0.0 && sample.rate < (1.0 - monitorDropThreshold)*sample.baseline);
+		if (sample.low) {
+			nLow++;
+			if (nLow == MONITORSUSTAIN) {
+				sample.dropping = 1;
+				nDrops++;
+			}
+		}
+		else {
+			recovered = sample.dropping;
+			sample.dropping = 0;
+			nLow = 0;
+			window[nextWindow] = sample.rate;
+			nextWindow = (nextWindow + 1) % MONITORWINDOW;
+			if (nWindow < MONITORWINDOW) nWindow++;
+		}
+
+		FormatTimestamp(sample.time, timestamp, sizeof(timestamp));
+		printf("%-24s   %9ld   %10.3lf   %10.3lf   %10.2lf   %13.3lf   %s\n", timestamp, nSamples, sample.rate,
+		       sample.bestRate, sample.latency, sample.baseline, sample.dropping ? "DROP" : sample.low ? "low" : "");
+		if (sample.low && nLow == MONITORSUSTAIN) {
+			printf("Sustained drop: triad %.3lf GB/s is %.1lf%% below the baseline of %.3lf GB/s for %d samples\n",
+			       sample.rate, (1.0 - sample.rate/sample.baseline)*100.0, sample.baseline, nLow);
+		}
+		else if (recovered) {
+			printf("Recovered: triad %.3lf GB/s against the baseline of %.3lf GB/s\n", sample.rate, sample.baseline);
+		}
+
+		WriteMonitorRecord(jsonFile, deviceName, vecWidth, localSize, nSamples, &sample);
+		if (ferror(jsonFile)) {
+			printf("Error writing %s\n", monitorJsonFile);
+			status = EXIT_FAILURE;
+			break;
+		}
+		if (WritePrometheusFile(monitorPromFile, deviceName, vecWidth, &sample, nSamples, nDrops) == EXIT_FAILURE) {
+			status = EXIT_FAILURE;
+			break;
+		}
+		fflush(stdout);
+
+		// Wait out the interval, longer if the sample would take more than the duty cycle of it. A signal cuts
+		// the wait short.
+		double period = sampleTime/monitorDutyCycle > monitorInterval ? sampleTime/monitorDutyCycle : monitorInterval;
+		double wait = sample.time + period - GetWallTime();
+		if (wait > 0.0 && !monitorStop && (monitorSamples == 0 || nSamples < monitorSamples)) {
+			struct timespec delay = {(time_t)wait, (long)((wait - (time_t)wait)*1.0e9)};
+			nanosleep(&delay, NULL);
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Stopped after %ld samples, %ld sustained drops\n", nSamples, nDrops);
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	fclose(jsonFile);
+	clReleaseKernel(chaseInitKernel);
+	clReleaseKernel(chaseKernel);
+	clReleaseMemObject(chaseList);
+	clReleaseMemObject(chaseSink);
+	return status;
+}
+
+
+
+// SIGINT and SIGTERM handler of the monitoring mode: stop after the current sample
+void MonitorSignal(int signum)
+{
+	(void)signum;
+	monitorStop = 1;
+}
+
+
+
+// Append one sample to the JSON lines file. Rates are in GB/s, as in the tables, and the runtime's choice of
+// work-group size is null.
+void WriteMonitorRecord(FILE *file, const char *deviceName, size_t vecWidth, size_t localSize, long sample, MonitorSample *s)
+{
+	char timestamp[64];
+	FormatTimestamp(s->time, timestamp, sizeof(timestamp));
+
+	fprintf(file, "{\"time\":\"%s\",\"unix_time\":%.3lf,\"device\":\"", timestamp, s->time);
+	PrintEscaped(file, deviceName);
+	fprintf(file, "\",\"type\":\"%s\",\"vecwidth\":%zu,", elementTypes[elementType].name, vecWidth);
+	if (localSize > 0) fprintf(file, "\"local_size\":%zu,", localSize);
+	else fprintf(file, "\"local_size\":null,");
+	fprintf(file, "\"sample\":%ld,\"triad_gbs\":%.3lf,\"triad_best_gbs\":%.3lf,\"latency_ns\":%.2lf,", sample, s->rate,
+	        s->bestRate, s->latency);
+	if (s->baseline > 0.0) fprintf(file, "\"baseline_gbs\":%.3lf,", s->baseline);
+	else fprintf(file, "\"baseline_gbs\":null,");
+	fprintf(file, "\"low\":%s,\"drop\":%s}\n", s->low ? "true" : "false", s->dropping ? "true" : "false");
+	fflush(file);
+}
+
+
+
+// Write the latest sample to a Prometheus text format file, eg. for the node exporter's textfile collector. Rates
+// are in bytes per second and latency in seconds, as Prometheus prefers base units. The file is written beside
+// the target and renamed over it, so readers never see half of it.
+int WritePrometheusFile(const char *path, const char *deviceName, size_t vecWidth, MonitorSample *s, long nSamples,
+                        long nDrops)
+{
+	const double gigabyte = 1024.0*1024.0*1024.0;
+	char tmpPath[1100];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	FILE *file = fopen(tmpPath, "w");
+	if (file == NULL) {
+		printf("Can't open %s: %s\n", tmpPath, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	const char * const names[8] = {
+		"opencl_stream_triad_bandwidth_bytes_per_second", "opencl_stream_triad_best_bandwidth_bytes_per_second",
+		"opencl_stream_triad_baseline_bandwidth_bytes_per_second", "opencl_stream_memory_latency_seconds",
+		"opencl_stream_triad_drop", "opencl_stream_samples_total", "opencl_stream_drops_total",
+		"opencl_stream_last_sample_timestamp_seconds"
+	};
+	const char * const help[8] = {
+		"Median triad bandwidth of the last sample", "Best triad bandwidth of the last sample",
+		"Rolling baseline of the median triad bandwidth, 0 until there are enough samples",
+		"Memory latency per load of the last sample, by pointer chasing",
+		"1 during a sustained drop of triad bandwidth below the baseline", "Samples taken",
+		"Sustained drops of triad bandwidth below the baseline", "Time of the last sample"
+	};
+	const double values[8] = {
+		s->rate*gigabyte, s->bestRate*gigabyte, s->baseline*gigabyte, s->latency*1.0e-9, s->dropping, nSamples, nDrops,
+		s->time
+	};
+	for (int m = 0; m < 8; m++) {
+		fprintf(file, "# HELP %s %s\n", names[m], help[m]);
+		fprintf(file, "# TYPE %s %s\n", names[m], m == 5 || m == 6 ? "counter" : "gauge");
+		fprintf(file, "%s{device=\"", names[m]);
+		PrintEscaped(file, deviceName);
+		fprintf(file, "\",type=\"%s\",vecwidth=\"%zu\"} %.17g\n", elementTypes[elementType].name, vecWidth, values[m]);
+	}
+
+	if (fclose(file) != 0 || rename(tmpPath, path) != 0) {
+		printf("Error writing %s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+
+// Print a string with backslashes and quotes escaped, for JSON strings and Prometheus label values
+void PrintEscaped(FILE *file, const char *string)
+{
+	for (const char *c = string; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') fputc('\\', file);
+		fputc(*c, file);
+	}
+}
+
+
+
+// ISO 8601 UTC timestamp with milliseconds of a wall time from GetWallTime
+void FormatTimestamp(double time, char *string, size_t length)
+{
+	time_t seconds = (time_t)time;
+	struct tm utc;
+	char date[32];
+
+	gmtime_r(&seconds, &utc);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &utc);
+	snprintf(string, length, "%s.%03dZ", date, (int)((time - seconds)*1000.0));
+}
+
+
+
+// Native host versions of the stream kernels for one element type, built for one instruction set through a
+// target attribute. The loops are left to the compiler to vectorise for it, or not for the scalar kernels, whose
+// LOOP pragma goes before each loop.
+#define NATIVE_KERNELS(T, SUFFIX, ATTR, LOOP) \
+ATTR void NativeCopy##SUFFIX(void *A, void *B, void *C, double scalar, size_t n) \
+{ \
+	const T * restrict a = A; \
+	T * restrict c = C; \
+	(void)B; (void)scalar; \
+	LOOP for (size_t i = 0; i < n; i++) c[i] = a[i]; \
+} \
+ATTR void NativeScale##SUFFIX(void *A, void *B, void *C, double scalar, size_t n) \
+{ \
+	T * restrict b = B; \
+	const T * restrict c = C; \
+	const T s = scalar; \
+	(void)A; \
+	LOOP for (size_t i = 0; i < n; i++) b[i] = s*c[i]; \
+} \
+ATTR void NativeAdd##SUFFIX(void *A, void *B, void *C, double scalar, size_t n) \
+{ \
+	const T * restrict a = A; \
+	const T * restrict b = B; \
+	T * restrict c = C; \
+	(void)scalar; \
+	LOOP for (size_t i = 0; i < n; i++) c[i] = a[i] + b[i]; \
+} \
+ATTR void NativeTriad##SUFFIX(void *A, void *B, void *C, double scalar, size_t n) \
+{ \
+	T * restrict a = A; \
+	const T * restrict b = B; \
+	const T * restrict c = C; \
+	const T s = scalar; \
+	LOOP for (size_t i = 0; i < n; i++) a[i] = b[i]*s + c[i]; \
+}
+#define NATIVE_TABLE(SUFFIX) {NativeCopy##SUFFIX, NativeScale##SUFFIX, NativeAdd##SUFFIX, NativeTriad##SUFFIX}
+#define NATIVE_NOTYPE {NULL, NULL, NULL, NULL}
+
+NATIVE_KERNELS(cl_double, DoubleScalar, NATIVE_SCALAR_ATTR, NATIVE_SCALAR_LOOP)
+NATIVE_KERNELS(cl_float, FloatScalar, NATIVE_SCALAR_ATTR, NATIVE_SCALAR_LOOP)
+NATIVE_KERNELS(cl_int, IntScalar, NATIVE_SCALAR_ATTR, NATIVE_SCALAR_LOOP)
+NATIVE_KERNELS(cl_long, LongScalar, NATIVE_SCALAR_ATTR, NATIVE_SCALAR_LOOP)
+NATIVE_KERNELS(cl_double, DoubleDefault, , )
+NATIVE_KERNELS(cl_float, FloatDefault, , )
+NATIVE_KERNELS(cl_int, IntDefault, , )
+NATIVE_KERNELS(cl_long, LongDefault, , )
+#ifdef NATIVE_X86
+NATIVE_KERNELS(cl_double, DoubleAVX2, __attribute__((target("avx2"))), )
+NATIVE_KERNELS(cl_float, FloatAVX2, __attribute__((target("avx2"))), )
+NATIVE_KERNELS(cl_int, IntAVX2, __attribute__((target("avx2"))), )
+NATIVE_KERNELS(cl_long, LongAVX2, __attribute__((target("avx2"))), )
+NATIVE_KERNELS(cl_double, DoubleAVX512, __attribute__((target("avx512f,prefer-vector-width=512"))), )
+NATIVE_KERNELS(cl_float, FloatAVX512, __attribute__((target("avx512f,prefer-vector-width=512"))), )
+NATIVE_KERNELS(cl_int, IntAVX512, __attribute__((target("avx512f,prefer-vector-width=512"))), )
+NATIVE_KERNELS(cl_long, LongAVX512, __attribute__((target("avx512f,prefer-vector-width=512"))), )
+#endif
+
+// Kernels of each instruction set and element type. There is no native half arithmetic.
+const NativeKernel nativeKernels[NISAS][NTYPES][NSTREAMKERNELS] = {
+	{NATIVE_TABLE(DoubleScalar), NATIVE_TABLE(FloatScalar), NATIVE_NOTYPE, NATIVE_TABLE(IntScalar), NATIVE_TABLE(LongScalar)},
+	{NATIVE_TABLE(DoubleDefault), NATIVE_TABLE(FloatDefault), NATIVE_NOTYPE, NATIVE_TABLE(IntDefault), NATIVE_TABLE(LongDefault)},
+#ifdef NATIVE_X86
+	{NATIVE_TABLE(DoubleAVX2), NATIVE_TABLE(FloatAVX2), NATIVE_NOTYPE, NATIVE_TABLE(IntAVX2), NATIVE_TABLE(LongAVX2)},
+	{NATIVE_TABLE(DoubleAVX512), NATIVE_TABLE(FloatAVX512), NATIVE_NOTYPE, NATIVE_TABLE(IntAVX512), NATIVE_TABLE(LongAVX512)}
+#endif
+};
+
+
+
+// Native host baseline of the stream kernels, to show how much of the host's bandwidth an OpenCL CPU device
+// leaves unused. A thread per CPU the process may run on is pinned to it, and initialises its own part of the
+// arrays, so on NUMA machines the pages are first touched, and placed, on the node that uses them. Each kernel
+// runs for every instruction set the CPU has, timed by host wall time across all threads, in the same table
+// as the OpenCL kernels (the work-group column is the thread count). If queue is not NULL, the OpenCL kernels of
+// vecWidth run first, and the ratio of their best rate to the best native one follows. Returns EXIT_FAILURE if
+// the native results are wrong.
+int RunNativeTest(cl_command_queue *queue, cl_kernel streamKernels[][NVECWIDTHS], double scalar, size_t arraySize,
+                  size_t vecWidth)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	NativePool pool;
+
+	if (nativeKernels[ISA_SCALAR][elementType][COPY] == NULL) {
+		printf("No native baseline for %s\n", elementTypes[elementType].name);
+		return EXIT_FAILURE;
+	}
+
+	// One thread per CPU in the affinity mask, each with a whole number of 16 item blocks
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) CPU_SET(0, &cpus);
+	int nThreads = CPU_COUNT(&cpus);
+	NativeThread *threads = malloc(nThreads*sizeof(NativeThread));
+	if (threads == NULL) {
+		printf("Error allocating native threads, line %d\n", __LINE__);
+		return EXIT_FAILURE;
+	}
+	size_t blocks = arraySize/16;
+	for (int t = 0, cpu = 0; t < nThreads; t++, cpu++) {
+		while (!CPU_ISSET(cpu, &cpus)) cpu++;
+		threads[t].pool = &pool;
+		threads[t].cpu = cpu;
+		threads[t].start = 16*(blocks*t/nThreads);
+		threads[t].n = 16*(blocks*(t+1)/nThreads) - threads[t].start;
+	}
+
+	pool.A = pool.B = pool.C = NULL;
+	if (posix_memalign(&pool.A, HOSTPTRALIGN, arraySize*elementSize) != 0 || posix_memalign(&pool.B, HOSTPTRALIGN, arraySize*elementSize) != 0
+	    || posix_memalign(&pool.C, HOSTPTRALIGN, arraySize*elementSize) != 0) {
+		printf("Error allocating native arrays, line %d\n", __LINE__);
+		free(pool.A);
+		free(pool.B);
+		free(pool.C);
+		free(threads);
+		return EXIT_FAILURE;
+	}
+	pool.scalar = scalar;
+	pthread_barrier_init(&pool.start, NULL, nThreads + 1);
+	pthread_barrier_init(&pool.done, NULL, nThreads + 1);
+	for (int t = 0; t < nThreads; t++) {
+		if (pthread_create(&threads[t].thread, NULL, NativeThreadMain, &threads[t]) != 0) {
+			printf("Error creating native thread %d\n", t);
+			exit(EXIT_FAILURE);
+		}
+	}
+	double initTime = RunNativeTask(&pool, NATIVEINIT);
+	printf("Native baseline: %d threads, %.1lf MB arrays first touched in %.3lf s\n", nThreads,
+	       arraySize*elementSize/1024.0/1024.0, initTime);
+
+	double bestOpenCL[NSTREAMKERNELS], bestNative[NSTREAMKERNELS];
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Function        Best Rate GB/s   Avg time   Min time   Max time   Best Workgroup Size   Best GFLOPS   Queue->Submit   Submit->Start\n");
+	for (int k = 0; k < NSTREAMKERNELS; k++) {
+		char testName[64];
+		TestResult result;
+		double bytes = (double)streamKernelInfo[k].memops*arraySize*elementSize/1024.0/1024.0/1024.0;
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+		if (queue != NULL) {
+			int v = 0;
+			while (vecWidths[v] != vecWidth) v++;
+			snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+			RunTest(queue, &streamKernels[k][v], vecWidth, arraySize, 0, &result);
+			PrintResult(testName, streamKernelInfo[k].memops, streamKernelInfo[k].flops, &result);
+			bestOpenCL[k] = streamKernelInfo[k].memops*result.items*elementSize/1024.0/1024.0/1024.0/result.minTime;
+		}
+
+		bestNative[k] = 0.0;
+		for (int isa = 0; isa < NISAS; isa++) {
+			if (!IsaSupported(isa)) continue;
+			for (int j = 0; j < NSTREAMKERNELS; j++) {
+				pool.kernels[j] = nativeKernels[isa][elementType][j];
+			}
+
+			double *times = malloc(NTIMES*sizeof(double));
+			for (int n = 0; n < warmupTimes; n++) {
+				RunNativeTask(&pool, k);
+			}
+			for (int n = 0; n < NTIMES; n++) {
+				times[n] = RunNativeTask(&pool, k);
+			}
+			GetTimeStatistics(times, NTIMES, &result);
+			free(times);
+			result.bestLocalSize = nThreads;
+			result.queuedToSubmit = 0.0;
+			result.submitToStart = 0.0;
+			result.items = arraySize;
+
+			snprintf(testName, sizeof(testName), "%s%s", streamKernelInfo[k].name, isaNames[isa]);
+			PrintResult(testName, streamKernelInfo[k].memops, streamKernelInfo[k].flops, &result);
+			if (bytes/result.minTime > bestNative[k]) bestNative[k] = bytes/result.minTime;
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+
+	if (queue != NULL) {
+		printf("Function        OpenCL GB/s   Native GB/s   OpenCL/Native\n");
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			char testName[64];
+			snprintf(testName, sizeof(testName), "%sKernel%zu", streamKernelInfo[k].name, vecWidth);
+			printf("%13s   %11.3lf   %11.3lf   %12.1lf%%\n", testName, bestOpenCL[k], bestNative[k],
+			       100.0*bestOpenCL[k]/bestNative[k]);
+		}
+		printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	}
+
+	RunNativeTask(&pool, NATIVEEXIT);
+	for (int t = 0; t < nThreads; t++) {
+		pthread_join(threads[t].thread, NULL);
+	}
+	pthread_barrier_destroy(&pool.start);
+	pthread_barrier_destroy(&pool.done);
+
+	// The kernels ran in STREAM order, so the arrays hold the result of one copy, scale, add, triad sequence
+	double expected[3];
+	void *arrays[3] = {pool.A, pool.B, pool.C};
+	int status = EXIT_SUCCESS;
+	GetExpectedValues(scalar, 1, &expected[0], &expected[1], &expected[2]);
+	for (int i = 0; i < 3; i++) {
+		size_t errors = 0, firstError = 0;
+		for (size_t j = 0; j < arraySize; j++) {
+			if (GetElement(arrays[i], j) != expected[i]) {
+				if (errors == 0) firstError = j;
+				errors++;
+			}
+		}
+		if (errors > 0) {
+			printf("Failed validation of native array %c: %zu of %zu items wrong, first at index %zu is %.6lg, expected %.6lg\n",
+			       "ABC"[i], errors, arraySize, firstError, GetElement(arrays[i], firstError), expected[i]);
+			status = EXIT_FAILURE;
+		}
+	}
+	if (status == EXIT_SUCCESS) {
+		printf("Native solution validates\n");
+	}
+
+	free(pool.A);
+	free(pool.B);
+	free(pool.C);
+	free(threads);
+	return status;
+}
+
+
+
+// Whether the CPU can run the native kernels of an instruction set
+int IsaSupported(int isa)
+{
+	switch (isa) {
+		case ISA_SCALAR:
+		case ISA_DEFAULT: return 1;
+#ifdef NATIVE_X86
+		case ISA_AVX2:   return __builtin_cpu_supports("avx2");
+		case ISA_AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+	}
+	return 0;
+}
+
+
+
+// Native thread: pin to its CPU, then run each task the pool is given on its part of the arrays
+void *NativeThreadMain(void *arg)
+{
+	NativeThread *thread = arg;
+	NativePool *pool = thread->pool;
+	const size_t elementSize = elementTypes[elementType].size;
+	const size_t offset = thread->start*elementSize;
+
+	cpu_set_t cpu;
+	CPU_ZERO(&cpu);
+	CPU_SET(thread->cpu, &cpu);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+
+	while (1) {
+		pthread_barrier_wait(&pool->start);
+		if (pool->task == NATIVEEXIT) break;
+
+		if (pool->task == NATIVEINIT) {
+			FillElements((char *)pool->A + offset, thread->n, 1.0);
+			FillElements((char *)pool->B + offset, thread->n, 2.0);
+			FillElements((char *)pool->C + offset, thread->n, 0.0);
+		}
+		else {
+			pool->kernels[pool->task]((char *)pool->A + offset, (char *)pool->B + offset, (char *)pool->C + offset,
+			                          pool->scalar, thread->n);
+		}
+		pthread_barrier_wait(&pool->done);
+	}
+	return NULL;
+}
+
+
+
+// Run one task on all the native threads, and return its wall time. NATIVEEXIT doesn't wait for the threads.
+double RunNativeTask(NativePool *pool, int task)
+{
+	pool->task = task;
+	double time = GetWallTime();
+	pthread_barrier_wait(&pool->start);
+	if (task == NATIVEEXIT) return 0.0;
+	pthread_barrier_wait(&pool->done);
+	return GetWallTime() - time;
+}
+
+
+
+// Check the arrays after the benchmark kernels have run. This expects the arrays to have been initialised and
+// then copy, scale, add and triad to have run in that order, each kernel running all its repetitions before the
+// next one starts. Each kernel writes an array that it doesn't read, so its repetitions leave the same values
+// as one run, and the arrays hold the result of a single copy, scale, add, triad sequence. Any other order or
+// interleaving gives other values. Returns EXIT_FAILURE if any array is wrong.
+int VerifyResults(cl_context *context, cl_program *program, cl_command_queue *queue, cl_mem *device_A, cl_mem *device_B,
+                  cl_mem *device_C, double scalar, size_t arraySize)
+{
+	cl_mem *arrays[3] = {device_A, device_B, device_C};
+	double expected[3];
+	VerifyResult results[3];
+	int status = EXIT_SUCCESS;
+
+	GetExpectedValues(scalar, 1, &expected[0], &expected[1], &expected[2]);
+	double startTime = GetWallTime();
+	for (int i = 0; i < 3; i++) {
+		if (VerifyArray(context, program, queue, arrays[i], expected[i], arraySize, &results[i]) == EXIT_FAILURE) {
+			status = EXIT_FAILURE;
+		}
+	}
+	double verifyTime = GetWallTime() - startTime;
+
+	if (status == EXIT_SUCCESS) {
+		printf("Solution validates on the device in %.3lf ms: avg abs error %.3le, %.3le, %.3le in A, B, C\n",
+		       verifyTime*1.0e3, results[0].avgAbsError, results[1].avgAbsError, results[2].avgAbsError);
+	}
+	else {
+		for (int i = 0; i < 3; i++) {
+			PrintVerifyFailure("ABC"[i], &results[i], expected[i], arraySize);
+		}
+	}
+	return status;
+}
+
+
+
+// STREAM-style validation: each iteration runs copy, scale, add and triad in turn, and the arrays are then
+// checked against the same recurrence computed on the host. Done separately for each vector width, so every
+// kernel variant is checked. Returns EXIT_FAILURE if any variant is wrong.
+int RunValidation(cl_context *context, cl_program programs[], cl_command_queue *queue, cl_kernel *initialiseArraysKernel,
+                  cl_kernel streamKernels[][NVECWIDTHS], cl_mem *device_A, cl_mem *device_B, cl_mem *device_C,
+                  double scalar, size_t arraySize)
+{
+	cl_mem *arrays[3] = {device_A, device_B, device_C};
+	int status = EXIT_SUCCESS;
+	cl_int err;
+
+	// Run as many iterations as keep the values in range of the element type, up to VALIDATENTIMES
+	int nIterations = 0;
+	double a, b, c;
+	while (nIterations < VALIDATENTIMES) {
+		GetExpectedValues(scalar, nIterations + 1, &a, &b, &c);
+		if (a > elementTypes[elementType].maxValue) break;
+		nIterations++;
+	}
+	double expected[3];
+	GetExpectedValues(scalar, nIterations, &expected[0], &expected[1], &expected[2]);
+
+	printf("Validating %d iterations of copy, scale, add, triad. Expected A = %.6lg, B = %.6lg, C = %.6lg\n",
+	       nIterations, expected[0], expected[1], expected[2]);
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("Kernels      Errors in A   Errors in B   Errors in C   Avg abs error A   Avg abs error B   Avg abs error C   Verify time ms\n");
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	for (int v = 0; v < NVECWIDTHS; v++) {
+		size_t initGlobalSize = arraySize;
+		size_t globalSize = arraySize/vecWidths[v];
+		err = clEnqueueNDRangeKernel(*queue, *initialiseArraysKernel, 1, NULL, &initGlobalSize, NULL, 0, NULL, NULL);
+		for (int k = 0; k < NSTREAMKERNELS; k++) {
+			err |= SetItemCountArg(&streamKernels[k][v], globalSize);
+		}
+		for (int n = 0; n < nIterations; n++) {
+			for (int k = 0; k < NSTREAMKERNELS; k++) {
+				err |= clEnqueueNDRangeKernel(*queue, streamKernels[k][v], 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+			}
+		}
+		clFinish(*queue);
+		CheckOpenCLError(err, __LINE__);
 
-// Number of times to run tests
-#define NTIMES 50
+		VerifyResult results[3];
+		int variantStatus = EXIT_SUCCESS;
+		double startTime = GetWallTime();
+		for (int i = 0; i < 3; i++) {
+			if (VerifyArray(context, &programs[0], queue, arrays[i], expected[i], arraySize, &results[i]) == EXIT_FAILURE) {
+				variantStatus = EXIT_FAILURE;
+			}
+		}
+		double verifyTime = GetWallTime() - startTime;
 
-// Print per-local-size results during test?
-//#define VERBOSE
+		char variantName[32];
+		snprintf(variantName, sizeof(variantName), "%s%zu", elementTypes[elementType].name, vecWidths[v]);
+		printf("%-9s   %12llu   %11llu   %11llu   %15.3le   %15.3le   %15.3le   %14.3lf\n", variantName,
+		       (unsigned long long)results[0].errors, (unsigned long long)results[1].errors, (unsigned long long)results[2].errors,
+		       results[0].avgAbsError, results[1].avgAbsError, results[2].avgAbsError, verifyTime*1.0e3);
+		if (variantStatus == EXIT_FAILURE) {
+			for (int i = 0; i < 3; i++) {
+				PrintVerifyFailure("ABC"[i], &results[i], expected[i], arraySize);
+			}
+			status = EXIT_FAILURE;
+		}
+	}
+	printf("-----------------------------------------------------------------------------------------------------------------------------------\n");
+	printf(status == EXIT_SUCCESS ? "Solution validates\n" : "Failed validation\n");
 
-// Function prototypes
-double GetWallTime(void);
-void RunTest(cl_command_queue * queue, cl_kernel * kernel, size_t vecWidth, char * testName, int memops, int flops, size_t arraySize);
-void VerifyResults(cl_command_queue * queue, cl_mem * device_A, double scalar, size_t arraySize);
-// OpenCL Stuff
-int InitialiseCLEnvironment(cl_platform_id**, cl_device_id***, cl_context*, cl_command_queue*, cl_program*, cl_ulong*, cl_ulong*);
-void CleanUpCLEnvironment(cl_platform_id**, cl_device_id***, cl_context*, cl_command_queue*, cl_program*);
-void CheckOpenCLError(cl_int err, int line);
+	return status;
+}
 
-const char * const kernelFileName = "src/kernels.cl";
 
 
-int main(void)
+// Values of a, b and c after nIterations of copy, scale, add, triad, from the initial a = 1, b = 2, c = 0
+void GetExpectedValues(double scalar, int nIterations, double *a, double *b, double *c)
 {
-	// Disable caching of binaries by nvidia implementation
-	setenv("CUDA_CACHE_DISABLE", "1", 1);
+	*a = 1.0;
+	*b = 2.0;
+	*c = 0.0;
+	for (int n = 0; n < nIterations; n++) {
+		*c = *a;
+		*b = scalar*(*c);
+		*c = *a + *b;
+		*a = (*b)*scalar + *c;
+	}
+}
 
-	// Set up OpenCL environment
-	cl_platform_id    *platform;
-	cl_device_id      **device_id;
-	cl_context        context;
-	cl_command_queue  queue;
-	cl_ulong          maxAlloc, globalMemSize;
-	cl_program        program;
-	cl_kernel         initialiseArraysKernel;
-	cl_kernel         copyKernel1,copyKernel2,copyKernel4,copyKernel8,copyKernel16;
-	cl_kernel         scaleKernel1,scaleKernel2,scaleKernel4,scaleKernel8,scaleKernel16;
-	cl_kernel         addKernel1,addKernel2,addKernel4,addKernel8,addKernel16;
-	cl_kernel         triadKernel1,triadKernel2,triadKernel4,triadKernel8,triadKernel16;
-	cl_int            err;
-	cl_mem            device_A, device_B, device_C;
 
-	if (InitialiseCLEnvironment(&platform, &device_id, &context, &queue, &program, &maxAlloc, &globalMemSize) == EXIT_FAILURE) {
-		printf("Error initialising OpenCL environment\n");
-		return EXIT_FAILURE;
-	}
 
-	// Create Kernels. We have a kernel of each vector size (scalar(1), 2, 4, 8, 16) for the
-	// stream functions copy, scale, add, triad.
-	initialiseArraysKernel = clCreateKernel(program, "initialiseArraysKernel", &err);
-	CheckOpenCLError(err, __LINE__);
-	copyKernel1 = clCreateKernel(program, "copyKernel1", &err);
-	copyKernel2 = clCreateKernel(program, "copyKernel2", &err);
-	copyKernel4 = clCreateKernel(program, "copyKernel4", &err);
-	copyKernel8 = clCreateKernel(program, "copyKernel8", &err);
-	copyKernel16 = clCreateKernel(program, "copyKernel16", &err);
-	CheckOpenCLError(err, __LINE__);
-	scaleKernel1 = clCreateKernel(program, "scaleKernel1", &err);
-	scaleKernel2 = clCreateKernel(program, "scaleKernel2", &err);
-	scaleKernel4 = clCreateKernel(program, "scaleKernel4", &err);
-	scaleKernel8 = clCreateKernel(program, "scaleKernel8", &err);
-	scaleKernel16 = clCreateKernel(program, "scaleKernel16", &err);
-	CheckOpenCLError(err, __LINE__);
-	addKernel1 = clCreateKernel(program, "addKernel1", &err);
-	addKernel2 = clCreateKernel(program, "addKernel2", &err);
-	addKernel4 = clCreateKernel(program, "addKernel4", &err);
-	addKernel8 = clCreateKernel(program, "addKernel8", &err);
-	addKernel16 = clCreateKernel(program, "addKernel16", &err);
-	CheckOpenCLError(err, __LINE__);
-	triadKernel1 = clCreateKernel(program, "triadKernel1", &err);
-	triadKernel2 = clCreateKernel(program, "triadKernel2", &err);
-	triadKernel4 = clCreateKernel(program, "triadKernel4", &err);
-	triadKernel8 = clCreateKernel(program, "triadKernel8", &err);
-	triadKernel16 = clCreateKernel(program, "triadKernel16", &err);
-	CheckOpenCLError(err, __LINE__);
+// Count the items of X more than the element type's relative tolerance away from the expected value, on the
+// device. The first wrong item is read back to report it. Returns EXIT_FAILURE if any item is wrong.
+int VerifyArray(cl_context *context, cl_program *program, cl_command_queue *queue, cl_mem *X, double expected,
+                size_t arraySize, VerifyResult *result)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+	const cl_ulong n = arraySize;
+	const cl_ulong nGroups = VERIFYGROUPS;
+	cl_device_id device;
+	size_t maxLocalSize, reduceMaxLocalSize, localSize;
+	cl_int err;
 
-	// Allocate device memory
-	size_t sizeBytes = TRYARRAYSIZE * sizeof(double);
-	if (sizeBytes > maxAlloc) sizeBytes = maxAlloc;
-	while (3*sizeBytes > globalMemSize) {
-		printf("Adjusting array size from %zuMB to %zuMB\n", sizeBytes, sizeBytes/2);
-		sizeBytes /= 2;
-	}
-	// Ensure new array size is a multiple of 256, the largest local workgroup size tested
-	size_t arraySize = sizeBytes/sizeof(double);
-	if ( arraySize % 256 != 0) {
-		// round down to multiple of 256
-		printf("Adjusting array size from %zuMB to %zuMB\n", arraySize*sizeof(double), ((arraySize/256)*256)*sizeof(double));
-		arraySize = (arraySize/256)*256;
-		sizeBytes = arraySize*sizeof(double);
-	}
-	device_A = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
-	device_B = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
-	device_C = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeBytes, NULL, &err);
+	cl_kernel verifyKernel = clCreateKernel(*program, "verifyKernel", &err);
+	CheckOpenCLError(err, __LINE__);
+	cl_kernel reduceKernel = clCreateKernel(*program, "verifyReduceKernel", &err);
 	CheckOpenCLError(err, __LINE__);
 
-	// Set kernel arguemnts. Scale and Triad kernels involve multiplication by a scalar:
-	const double scalar = 3.0;
+	// The reductions halve the work-group at each step, so the local size is a power of two
+	clGetCommandQueueInfo(*queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	clGetKernelWorkGroupInfo(verifyKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, NULL);
+	clGetKernelWorkGroupInfo(reduceKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(reduceMaxLocalSize), &reduceMaxLocalSize, NULL);
+	if (reduceMaxLocalSize < maxLocalSize) maxLocalSize = reduceMaxLocalSize;
+	for (localSize = 1; localSize*2 <= maxLocalSize && localSize*2 <= VERIFYLOCALSIZE; localSize *= 2);
 
-	err  = clSetKernelArg(initialiseArraysKernel, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(initialiseArraysKernel, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(initialiseArraysKernel, 2, sizeof(cl_mem), &device_C);
+	// The error sum is a double where the device has fp64 and a float otherwise, as ERRTYPE in the kernels
+	const int errDouble = DeviceHasExtension(&device, "cl_khr_fp64");
+	const size_t errSize = errDouble ? sizeof(cl_double) : sizeof(cl_float);
 
-	err |= clSetKernelArg(copyKernel1, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(copyKernel1, 1, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(copyKernel2, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(copyKernel2, 1, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(copyKernel4, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(copyKernel4, 1, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(copyKernel8, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(copyKernel8, 1, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(copyKernel16, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(copyKernel16, 1, sizeof(cl_mem), &device_C);
-
-	err |= clSetKernelArg(scaleKernel1, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(scaleKernel1, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(scaleKernel1, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(scaleKernel2, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(scaleKernel2, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(scaleKernel2, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(scaleKernel4, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(scaleKernel4, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(scaleKernel4, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(scaleKernel8, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(scaleKernel8, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(scaleKernel8, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(scaleKernel16, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(scaleKernel16, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(scaleKernel16, 2, sizeof(cl_mem), &device_C);
-
-	err |= clSetKernelArg(addKernel1, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(addKernel1, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(addKernel1, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(addKernel2, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(addKernel2, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(addKernel2, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(addKernel4, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(addKernel4, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(addKernel4, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(addKernel8, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(addKernel8, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(addKernel8, 2, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(addKernel16, 0, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(addKernel16, 1, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(addKernel16, 2, sizeof(cl_mem), &device_C);
-
-	err |= clSetKernelArg(triadKernel1, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(triadKernel1, 1, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(triadKernel1, 2, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(triadKernel1, 3, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(triadKernel2, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(triadKernel2, 1, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(triadKernel2, 2, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(triadKernel2, 3, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(triadKernel4, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(triadKernel4, 1, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(triadKernel4, 2, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(triadKernel4, 3, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(triadKernel8, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(triadKernel8, 1, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(triadKernel8, 2, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(triadKernel8, 3, sizeof(cl_mem), &device_C);
-	err |= clSetKernelArg(triadKernel16, 0, sizeof(double), &scalar);
-	err |= clSetKernelArg(triadKernel16, 1, sizeof(cl_mem), &device_A);
-	err |= clSetKernelArg(triadKernel16, 2, sizeof(cl_mem), &device_B);
-	err |= clSetKernelArg(triadKernel16, 3, sizeof(cl_mem), &device_C);
+	cl_mem groupErrors = clCreateBuffer(*context, CL_MEM_READ_WRITE, nGroups*sizeof(cl_ulong), NULL, &err);
+	cl_mem groupFirst = clCreateBuffer(*context, CL_MEM_READ_WRITE, nGroups*sizeof(cl_ulong), NULL, &err);
+	cl_mem groupErrSum = clCreateBuffer(*context, CL_MEM_READ_WRITE, nGroups*errSize, NULL, &err);
 	CheckOpenCLError(err, __LINE__);
 
+	err  = clSetKernelArg(verifyKernel, 0, sizeof(cl_mem), X);
+	err |= SetScalarKernelArg(&verifyKernel, 1, expected);
+	err |= SetScalarKernelArg(&verifyKernel, 2, elementTypes[elementType].epsilon*fabs(expected));
+	err |= clSetKernelArg(verifyKernel, 3, sizeof(cl_ulong), &n);
+	err |= clSetKernelArg(verifyKernel, 4, sizeof(cl_mem), &groupErrors);
+	err |= clSetKernelArg(verifyKernel, 5, sizeof(cl_mem), &groupFirst);
+	err |= clSetKernelArg(verifyKernel, 6, sizeof(cl_mem), &groupErrSum);
+	err |= clSetKernelArg(verifyKernel, 7, localSize*sizeof(cl_ulong), NULL);
+	err |= clSetKernelArg(verifyKernel, 8, localSize*sizeof(cl_ulong), NULL);
+	err |= clSetKernelArg(verifyKernel, 9, localSize*errSize, NULL);
+	err |= clSetKernelArg(reduceKernel, 0, sizeof(cl_mem), &groupErrors);
+	err |= clSetKernelArg(reduceKernel, 1, sizeof(cl_mem), &groupFirst);
+	err |= clSetKernelArg(reduceKernel, 2, sizeof(cl_mem), &groupErrSum);
+	err |= clSetKernelArg(reduceKernel, 3, sizeof(cl_ulong), &nGroups);
+	err |= clSetKernelArg(reduceKernel, 4, localSize*sizeof(cl_ulong), NULL);
+	err |= clSetKernelArg(reduceKernel, 5, localSize*sizeof(cl_ulong), NULL);
+	err |= clSetKernelArg(reduceKernel, 6, localSize*errSize, NULL);
+	CheckOpenCLError(err, __LINE__);
 
-	// Initialize arrays
-	size_t initLocalSize = 32;
-	size_t initGlobalSize = arraySize;
-	err = clEnqueueNDRangeKernel(queue, initialiseArraysKernel, 1, NULL, &initGlobalSize, &initLocalSize, 0, NULL, NULL);
-	clFinish(queue);
+	size_t globalSize = nGroups*localSize;
+	cl_double errSumDouble;
+	cl_float errSumFloat;
+	err  = clEnqueueNDRangeKernel(*queue, verifyKernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(*queue, reduceKernel, 1, NULL, &localSize, &localSize, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(*queue, groupErrors, CL_FALSE, 0, sizeof(cl_ulong), &result->errors, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(*queue, groupFirst, CL_FALSE, 0, sizeof(cl_ulong), &result->firstError, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(*queue, groupErrSum, CL_TRUE, 0, errSize, errDouble ? (void *)&errSumDouble : (void *)&errSumFloat,
+	                           0, NULL, NULL);
+	CheckOpenCLError(err, __LINE__);
+	result->avgAbsError = (errDouble ? errSumDouble : errSumFloat)/arraySize;
 
+	result->firstValue = 0.0;
+	if (result->errors > 0) {
+		unsigned char value[sizeof(cl_double)];
+		err = clEnqueueReadBuffer(*queue, *X, CL_TRUE, result->firstError*elementSize, elementSize, value, 0, NULL, NULL);
+		CheckOpenCLError(err, __LINE__);
+		result->firstValue = GetElement(value, 0);
+	}
 
-	// Fourth argument is the number of memory operations per output array item. Used in bandwidth calculation.
-	// Fifth argument is the number of flops per output array item. Used in flops calculation.
-	printf("---------------------------------------------------------------------------------------------------\n");
-	printf("Function        Best Rate GB/s   Avg time   Min time   Max time   Best Workgroup Size   Best GFLOPS\n");
-	printf("---------------------------------------------------------------------------------------------------\n");
-	RunTest(&queue, &copyKernel1,  1,  "copyKernel1",  2, 0, arraySize);
-	RunTest(&queue, &copyKernel2,  2,  "copyKernel2",  2, 0, arraySize);
-	RunTest(&queue, &copyKernel4,  4,  "copyKernel4",  2, 0, arraySize);
-	RunTest(&queue, &copyKernel8,  8,  "copyKernel8",  2, 0, arraySize);
-	RunTest(&queue, &copyKernel16, 16, "copyKernel16", 2, 0, arraySize);
-	printf("---------------------------------------------------------------------------------------------------\n");
-	RunTest(&queue, &scaleKernel1,  1,  "scaleKernel1",  2, 1, arraySize);
-	RunTest(&queue, &scaleKernel2,  2,  "scaleKernel2",  2, 1, arraySize);
-	RunTest(&queue, &scaleKernel4,  4,  "scaleKernel4",  2, 1, arraySize);
-	RunTest(&queue, &scaleKernel8,  8,  "scaleKernel8",  2, 1, arraySize);
-	RunTest(&queue, &scaleKernel16, 16, "scaleKernel16", 2, 1, arraySize);
-	printf("---------------------------------------------------------------------------------------------------\n");
-	RunTest(&queue, &addKernel1,  1,  "addKernel1",  2, 1, arraySize);
-	RunTest(&queue, &addKernel2,  2,  "addKernel2",  2, 1, arraySize);
-	RunTest(&queue, &addKernel4,  4,  "addKernel4",  2, 1, arraySize);
-	RunTest(&queue, &addKernel8,  8,  "addKernel8",  2, 1, arraySize);
-	RunTest(&queue, &addKernel16, 16, "addKernel16", 2, 1, arraySize);
-	printf("---------------------------------------------------------------------------------------------------\n");
-	RunTest(&queue, &triadKernel1,  1,  "triadKernel1",  3, 2, arraySize);
-	RunTest(&queue, &triadKernel2,  2,  "triadKernel2",  3, 2, arraySize);
-	RunTest(&queue, &triadKernel4,  4,  "triadKernel4",  3, 2, arraySize);
-	RunTest(&queue, &triadKernel8,  8,  "triadKernel8",  3, 2, arraySize);
-	RunTest(&queue, &triadKernel16, 16, "triadKernel16", 3, 2, arraySize);
-	printf("---------------------------------------------------------------------------------------------------\n");
-
-	// Check results are correct
-	VerifyResults(&queue, &device_A, scalar, arraySize);
-
-	CleanUpCLEnvironment(&platform, &device_id, &context, &queue, &program);
-	return 0;
+	clReleaseMemObject(groupErrors);
+	clReleaseMemObject(groupFirst);
+	clReleaseMemObject(groupErrSum);
+	clReleaseKernel(verifyKernel);
+	clReleaseKernel(reduceKernel);
+	return result->errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 
 
-void RunTest(cl_command_queue * queue, cl_kernel * kernel, size_t vecWidth, char * testName, int memops, int flops, size_t arraySize)
+void PrintVerifyFailure(char arrayName, VerifyResult *result, double expected, size_t arraySize)
 {
-	size_t localSize;
-	size_t bestLocalSize;
-	size_t globalSize = arraySize/vecWidth;
-	double bestTime = DBL_MAX, worstTime = DBL_MIN, totalTime = 0.0;
-	int err;
+	if (result->errors == 0) return;
+	printf("Failed validation of array %c: %llu of %zu items wrong, first at index %llu is %.6lg, expected %.6lg\n",
+	       arrayName, (unsigned long long)result->errors, arraySize, (unsigned long long)result->firstError,
+	       result->firstValue, expected);
+}
 
-	// Test local sizes from 2 to to 256, in powers of 2
-	for (localSize = 1; localSize <= 256; localSize *= 2) {
 
-		if (globalSize % localSize != 0) {
-			printf("Error, localSize must divide globalSize! (%zu %% %zu = %zu)\n",
-			       globalSize, localSize, globalSize%localSize);
-		}
 
-		double time = GetWallTime();
+// Set a kernel argument of the current element type from a double
+cl_int SetScalarKernelArg(cl_kernel *kernel, cl_uint index, double value)
+{
+	cl_double doubleValue = value;
+	cl_float floatValue = value;
+	cl_half halfValue = FloatToHalf(value);
+	cl_int intValue = value;
+	cl_long longValue = value;
 
-		for (int n = 0; n < NTIMES; n++) {
-			err = clEnqueueNDRangeKernel(*queue, *kernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
-		}
-		clFinish(*queue);
-		CheckOpenCLError(err, __LINE__);
+	switch (elementType) {
+		case TYPE_DOUBLE: return clSetKernelArg(*kernel, index, sizeof(doubleValue), &doubleValue);
+		case TYPE_FLOAT:  return clSetKernelArg(*kernel, index, sizeof(floatValue), &floatValue);
+		case TYPE_HALF:   return clSetKernelArg(*kernel, index, sizeof(halfValue), &halfValue);
+		case TYPE_INT:    return clSetKernelArg(*kernel, index, sizeof(intValue), &intValue);
+		case TYPE_LONG:   return clSetKernelArg(*kernel, index, sizeof(longValue), &longValue);
+	}
+	return CL_INVALID_VALUE;
+}
 
-		time = GetWallTime() - time;
-		if (time < bestTime) {
-			bestTime = time;
-			bestLocalSize = localSize;
-		}
-		if (time > worstTime) {
-			worstTime = time;
-		}
-		totalTime += time;
 
-#ifdef VERBOSE
-		printf("------------- localSize = %3zu, bandwidth = %7.3lf GB/s\n",
-		        localSize, memops*NTIMES*arraySize*sizeof(double)/1024.0/1024.0/1024.0/(time));
-#endif
 
+// Return item i of an array of the current element type, as a double
+double GetElement(const void *array, size_t i)
+{
+	switch (elementType) {
+		case TYPE_DOUBLE: return ((const cl_double *)array)[i];
+		case TYPE_FLOAT:  return ((const cl_float *)array)[i];
+		case TYPE_HALF:   return HalfToFloat(((const cl_half *)array)[i]);
+		case TYPE_INT:    return ((const cl_int *)array)[i];
+		case TYPE_LONG:   return ((const cl_long *)array)[i];
 	}
-
-	printf("%13s   %14.3lf   %8.6lf   %8.6lf   %8.6lf   %19zu   %11.3lf\n",
-	       testName, memops*NTIMES*arraySize*sizeof(double)/1024.0/1024.0/1024.0/bestTime, totalTime/NTIMES,
-	       bestTime, worstTime, bestLocalSize, flops*NTIMES*arraySize/1.0e9/bestTime);
+	return 0.0;
 }
 
 
 
-void VerifyResults(cl_command_queue *queue, cl_mem *device_A, double scalar, size_t arraySize)
+// Set the first n items of an array of the current element type to value, doubling the filled part by copying
+void FillElements(void *array, size_t n, double value)
 {
-	// Triad puts final values in array A, so retrieve it from the card. Allocate memory to recieve:
-	size_t sizeBytes = arraySize * sizeof(double);
-	double *checkA;
-	checkA = malloc(sizeBytes);
-	clEnqueueReadBuffer(*queue, *device_A, CL_TRUE, 0, sizeBytes, checkA, 0, NULL, NULL);
+	const size_t elementSize = elementTypes[elementType].size;
+	cl_double doubleValue = value;
+	cl_float floatValue = value;
+	cl_half halfValue = FloatToHalf(value);
+	cl_int intValue = value;
+	cl_long longValue = value;
 
-	// Unlike the original stream benchmark, we don't interleave the functions.
-	// The initial values were: a = 1.0, b = 2.0, c = 0.0.
-	double a = 1.0;
-	double b = 2.0;
-	double c = 0.0;
-	// Copy
-	c = a;
-	b = scalar*c;
-	c = a + b;
-	a = b*scalar + c;
-
-	int errors = 0;
-	for (size_t i = 0; i < arraySize; i++) {
-		if (checkA[i] != a) {
-			errors++;
-		}
+	if (n == 0) return;
+	switch (elementType) {
+		case TYPE_DOUBLE: memcpy(array, &doubleValue, elementSize); break;
+		case TYPE_FLOAT:  memcpy(array, &floatValue, elementSize); break;
+		case TYPE_HALF:   memcpy(array, &halfValue, elementSize); break;
+		case TYPE_INT:    memcpy(array, &intValue, elementSize); break;
+		case TYPE_LONG:   memcpy(array, &longValue, elementSize); break;
 	}
-	if (errors != 0) {
-		printf("Error in result!\n");
+	for (size_t filled = 1; filled < n; filled *= 2) {
+		memcpy((char *)array + filled*elementSize, array, (filled < n - filled ? filled : n - filled)*elementSize);
 	}
+}
+
+
 
+// Convert between float and IEEE half precision. Values too small for a normal half are flushed to zero,
+// and the mantissa is truncated, which is exact for the small integers used by the tests.
+cl_half FloatToHalf(float f)
+{
+	union { float f; cl_uint u; } v = { f };
+	cl_uint sign = (v.u >> 16) & 0x8000;
+	cl_int exponent = (cl_int)((v.u >> 23) & 0xff) - 127 + 15;
+	cl_uint mantissa = v.u & 0x7fffff;
+
+	if (exponent <= 0) return sign;
+	if (exponent >= 31) return sign | 0x7c00;
+	return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+float HalfToFloat(cl_half h)
+{
+	union { float f; cl_uint u; } v;
+	cl_uint sign = (cl_uint)(h & 0x8000) << 16;
+	cl_uint exponent = (h >> 10) & 0x1f;
+	cl_uint mantissa = h & 0x3ff;
+
+	if (exponent == 0) v.u = sign;
+	else if (exponent == 31) v.u = sign | 0x7f800000 | (mantissa << 13);
+	else v.u = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	return v.f;
 }
 
 
@@ -320,23 +4124,63 @@ double GetWallTime(void)
 
 
 
+// Return the time in seconds between two profiling points of an event. The queue must have been
+// created with CL_QUEUE_PROFILING_ENABLE.
+double GetEventTime(cl_event event, cl_profiling_info from, cl_profiling_info to)
+{
+	cl_ulong fromTime, toTime;
+	cl_int err;
+
+	err  = clGetEventProfilingInfo(event, from, sizeof(fromTime), &fromTime, NULL);
+	err |= clGetEventProfilingInfo(event, to, sizeof(toTime), &toTime, NULL);
+	CheckOpenCLError(err, __LINE__);
+	return 1e-9*(double)(toTime - fromTime);
+}
+
+
+
+// Return a profiling timestamp of an event, in ns. Timestamps are comparable between queues of one device.
+cl_ulong GetEventTimestamp(cl_event event, cl_profiling_info point)
+{
+	cl_ulong time;
+	cl_int err = clGetEventProfilingInfo(event, point, sizeof(time), &time, NULL);
+	CheckOpenCLError(err, __LINE__);
+	return time;
+}
+
+
+
+// Return the number of items in each of the three arrays, for arrays of up to sizeBytes that fit on the device
+size_t GetArraySize(size_t sizeBytes, cl_ulong maxAlloc, cl_ulong globalMemSize)
+{
+	const size_t elementSize = elementTypes[elementType].size;
+
+	if (sizeBytes > maxAlloc) sizeBytes = maxAlloc;
+	while (3*sizeBytes > globalMemSize) {
+		printf("Adjusting array size from %zuMB to %zuMB\n", sizeBytes/1024/1024, sizeBytes/2/1024/1024);
+		sizeBytes /= 2;
+	}
+	// Ensure new array size is a multiple of 16, the largest vector width. Local sizes don't need to divide it,
+	// the global size is rounded up to whole work-groups and the extra work-items do nothing.
+	size_t arraySize = sizeBytes/elementSize;
+	if ( arraySize % 16 != 0) {
+		// round down to multiple of 16
+		printf("Adjusting array size from %zuMB to %zuMB\n", arraySize*elementSize/1024/1024, ((arraySize/16)*16)*elementSize/1024/1024);
+		arraySize = (arraySize/16)*16;
+	}
+	return arraySize;
+}
+
+
+
 // OpenCL functions
-int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id, cl_context *context, cl_command_queue *queue, cl_program *program, cl_ulong *maxAlloc, cl_ulong *globalMemSize)
+int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id, cl_device_id *device, cl_context *context, cl_command_queue *queue, cl_ulong *maxAlloc, cl_ulong *globalMemSize,
+                            const char *deviceChoice)
 {
 	//error flag
 	cl_int err;
 	char infostring[1024];
 
-	//get kernel from file
-	FILE* kernelFile = fopen(kernelFileName, "rb");
-	fseek(kernelFile, 0, SEEK_END);
-	long fileLength = ftell(kernelFile);
-	rewind(kernelFile);
-	char *kernelSource = malloc(fileLength*sizeof(char));
-	long read = fread(kernelSource, sizeof(char), fileLength, kernelFile);
-	if (fileLength != read) printf("Error reading kernel file, line %d\n", __LINE__);
-	fclose(kernelFile);
-
 	//get platform and device information
 	cl_uint numPlatforms;
 	err = clGetPlatformIDs(0, NULL, &numPlatforms);
@@ -376,9 +4220,18 @@ int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id
 		}
 	}
 
-	// Get platform and device from user:
+	// Get platform and device from --device, or else from user:
 	cl_long chosenPlatform = -1, chosenDevice = -1;
-	if (numPlatforms == 1) {
+	if (deviceChoice != NULL) {
+		if (sscanf(deviceChoice, "%ld:%ld", &chosenPlatform, &chosenDevice) != 2 || chosenPlatform < 0
+		    || chosenPlatform >= numPlatforms || chosenDevice < 0 || chosenDevice >= numDevices[chosenPlatform]) {
+			printf("No device %s\n", deviceChoice);
+			free(numDevices);
+			return EXIT_FAILURE;
+		}
+		printf("Using device %ld:%ld.\n", chosenPlatform, chosenDevice);
+	}
+	else if (numPlatforms == 1) {
 		chosenPlatform = 0;
 		printf("Auto-selecting platform %lu.\n", chosenPlatform);
 	} else while (chosenPlatform < 0) {
@@ -393,7 +4246,7 @@ int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id
 			printf("Platform has no devices.\n");
 		}
 	}
-	if (numDevices[chosenPlatform] == 1) {
+	if (deviceChoice == NULL && numDevices[chosenPlatform] == 1) {
 		chosenDevice = 0;
 		printf("Auto-selecting device %lu.\n", chosenDevice);
 	} else while (chosenDevice < 0) {
@@ -406,6 +4259,8 @@ int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id
 	}
 	printf("\n");
 
+	*device = (*device_id)[chosenPlatform][chosenDevice];
+
 	//store global mem size and max allocation size
 	clGetDeviceInfo((*device_id)[chosenPlatform][chosenDevice], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(*globalMemSize), globalMemSize, NULL);
 	clGetDeviceInfo((*device_id)[chosenPlatform][chosenDevice], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(*maxAlloc), maxAlloc, NULL);
@@ -413,50 +4268,341 @@ int InitialiseCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id
 	//create a context
 	*context = clCreateContext(NULL, 1, &((*device_id)[chosenPlatform][chosenDevice]), NULL, NULL, &err);
 	CheckOpenCLError(err, __LINE__);
-	//create a queue
-	*queue = clCreateCommandQueue(*context, (*device_id)[chosenPlatform][chosenDevice], 0, &err);
+	//create a queue. Profiling is enabled so that each kernel launch can be timed on the device.
+	*queue = clCreateCommandQueue(*context, (*device_id)[chosenPlatform][chosenDevice], CL_QUEUE_PROFILING_ENABLE, &err);
 	CheckOpenCLError(err, __LINE__);
 
+	free(numDevices);
+	return EXIT_SUCCESS;
+}
+
+
+
+// Build the kernels for the current element type and the given vector width. If the program cache is
+// enabled, a binary cached by an earlier run is used when its key matches, otherwise the program is built
+// from source and its binary saved to the cache.
+int BuildProgram(cl_context *context, cl_device_id *device, size_t vecWidth, cl_program *program)
+{
+	cl_int err;
+	char options[256];
+	char key[2048];
+	char cacheFile[1024];
+
+	//get kernel from file
+	FILE* kernelFile = fopen(kernelFileName, "rb");
+	if (kernelFile == NULL) {
+		printf("Error opening kernel file %s\n", kernelFileName);
+		return EXIT_FAILURE;
+	}
+	fseek(kernelFile, 0, SEEK_END);
+	long fileLength = ftell(kernelFile);
+	rewind(kernelFile);
+	char *kernelSource = malloc(fileLength*sizeof(char));
+	long read = fread(kernelSource, sizeof(char), fileLength, kernelFile);
+	if (fileLength != read) printf("Error reading kernel file, line %d\n", __LINE__);
+	fclose(kernelFile);
+
+	snprintf(options, sizeof(options), "-I. -I src/ -D TYPE=%s -D VECWIDTH=%zu", elementTypes[elementType].name, vecWidth);
+
+	// Look for a cached binary
+	if (programCacheDir != NULL) {
+		GetProgramCacheKey(device, options, kernelSource, fileLength, key, sizeof(key));
+		snprintf(cacheFile, sizeof(cacheFile), "%s/%016llx.bin", programCacheDir,
+		         (unsigned long long)HashBytes(key, strlen(key), FNVOFFSET));
+
+		double buildTime;
+		double time = GetWallTime();
+		if (LoadCachedProgram(context, device, options, key, cacheFile, program, &buildTime) == EXIT_SUCCESS) {
+			printf("---OpenCL: %s%zu program loaded from cache in %.1lf ms (source build took %.1lf ms)\n",
+			       elementTypes[elementType].name, vecWidth, (GetWallTime() - time)*1.0e3, buildTime*1.0e3);
+			free(kernelSource);
+			return EXIT_SUCCESS;
+		}
+	}
+
 	//create the program with the source above
-//	printf("Creating CL Program...\n");
-	*program = clCreateProgramWithSource(*context, 1, (const char**)&kernelSource, NULL, &err);
+	double time = GetWallTime();
+	const size_t sourceLength = fileLength;
+	*program = clCreateProgramWithSource(*context, 1, (const char**)&kernelSource, &sourceLength, &err);
+	free(kernelSource);
 	if (err != CL_SUCCESS) {
 		printf("Error in clCreateProgramWithSource: %d, line %d.\n", err, __LINE__);
 		return EXIT_FAILURE;
 	}
 
 	//build program executable
-//	printf("Building CL Executable...\n");
-	err = clBuildProgram(*program, 0, NULL, "-I. -I src/", NULL, NULL);
+	err = clBuildProgram(*program, 1, device, options, NULL, NULL);
 	if (err != CL_SUCCESS) {
 		printf("Error in clBuildProgram: %d, line %d.\n", err, __LINE__);
 		char buffer[5000];
-		clGetProgramBuildInfo(*program, (*device_id)[chosenPlatform][chosenDevice], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
+		clGetProgramBuildInfo(*program, *device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
 		printf("%s\n", buffer);
 		return EXIT_FAILURE;
 	}
+	time = GetWallTime() - time;
+	printf("---OpenCL: %s%zu program built from source in %.1lf ms\n", elementTypes[elementType].name, vecWidth, time*1.0e3);
+
+	if (programCacheDir != NULL) {
+		SaveCachedProgram(program, key, cacheFile, time);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+
+// The cache key identifies everything that changes the compiled program: the platform and its version, the
+// device, its driver version, the build options and (by hash) the kernel source.
+void GetProgramCacheKey(cl_device_id *device, const char *options, const char *source, size_t sourceLength, char *key, size_t keyLength)
+{
+	cl_platform_id platform;
+	char platformName[256], platformVersion[256], deviceName[256], driverVersion[256];
+
+	clGetDeviceInfo(*device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+	clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(platformName), platformName, NULL);
+	clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(platformVersion), platformVersion, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+	clGetDeviceInfo(*device, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL);
+
+	snprintf(key, keyLength, "%s|%s|%s|%s|%s|%016llx", platformName, platformVersion, deviceName, driverVersion,
+	         options, (unsigned long long)HashBytes(source, sourceLength, FNVOFFSET));
+}
+
+
+
+// Cache files hold the key, the source build time in seconds and the binary size on one line each, then the
+// binary. Returns EXIT_FAILURE if there is no usable entry, including when the runtime
+// rejects the binary, so that the caller builds from source instead.
+int LoadCachedProgram(cl_context *context, cl_device_id *device, const char *options, const char *key, const char *cacheFile,
+                      cl_program *program, double *buildTime)
+{
+	char fileKey[2048], line[64];
+	size_t binSize;
+	cl_int err, binaryStatus;
+
+	FILE *fp = fopen(cacheFile, "rb");
+	if (fp == NULL) return EXIT_FAILURE;
+
+	// A different key in the file means a hash collision, treat it as a miss
+	if (fgets(fileKey, sizeof(fileKey), fp) == NULL || strncmp(fileKey, key, strlen(key)) != 0 || fileKey[strlen(key)] != '\n'
+	    || fgets(line, sizeof(line), fp) == NULL || sscanf(line, "%lf", buildTime) != 1
+	    || fgets(line, sizeof(line), fp) == NULL || sscanf(line, "%zu", &binSize) != 1) {
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
+	unsigned char *bin = malloc(binSize);
+	size_t read = fread(bin, 1, binSize, fp);
+	fclose(fp);
+	if (read != binSize) {
+		free(bin);
+		return EXIT_FAILURE;
+	}
+
+	*program = clCreateProgramWithBinary(*context, 1, device, &binSize, (const unsigned char **)&bin, &binaryStatus, &err);
+	free(bin);
+	if (err == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+		err = clBuildProgram(*program, 1, device, options, NULL, NULL);
+		if (err == CL_SUCCESS) return EXIT_SUCCESS;
+		clReleaseProgram(*program);
+	}
+	if (err == CL_SUCCESS) err = binaryStatus;
+	printf("---OpenCL: cached program %s rejected, ", cacheFile);
+	CheckOpenCLError(err, __LINE__);
+	return EXIT_FAILURE;
+}
+
+
 
-	// dump ptx
+void SaveCachedProgram(cl_program *program, const char *key, const char *cacheFile, double buildTime)
+{
 	size_t binSize;
 	clGetProgramInfo(*program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binSize, NULL);
 	unsigned char *bin = malloc(binSize);
 	clGetProgramInfo(*program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &bin, NULL);
-	FILE *fp = fopen("openclPTX.ptx", "wb");
+
+	// Write to a temporary file and rename it, so a concurrent run never reads a partial entry. mkstemp makes the
+	// name unique to this call, as the --multidevice threads of one process can save the same entry at once.
+	char tmpFile[1100];
+	snprintf(tmpFile, sizeof(tmpFile), "%s.XXXXXX", cacheFile);
+	int fd = mkstemp(tmpFile);
+	FILE *fp = (fd < 0 ? NULL : fdopen(fd, "wb"));
+	if (fp == NULL) {
+		printf("---OpenCL: can't write program cache file %s\n", tmpFile);
+		if (fd >= 0) {
+			close(fd);
+			remove(tmpFile);
+		}
+		free(bin);
+		return;
+	}
+	fchmod(fd, 0644);
+	fprintf(fp, "%s\n%.9lf\n%zu\n", key, buildTime, binSize);
 	fwrite(bin, sizeof(char), binSize, fp);
-	fclose(fp);
+	if (fclose(fp) != 0 || rename(tmpFile, cacheFile) != 0) remove(tmpFile);
 	free(bin);
+}
 
-	free(numDevices);
-	free(kernelSource);
+
+
+// 64 bit FNV-1a hash. Pass FNVOFFSET to start a new hash, or a previous result to continue one.
+cl_ulong HashBytes(const void *data, size_t length, cl_ulong hash)
+{
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+
+// Create a directory and any missing parents
+int MakeDirectory(const char *path)
+{
+	char partial[1024];
+	snprintf(partial, sizeof(partial), "%s", path);
+	for (char *p = partial + 1; *p != '\0'; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(partial, 0755);
+			*p = '/';
+		}
+	}
+	if (mkdir(partial, 0755) != 0 && errno != EEXIST) return EXIT_FAILURE;
 	return EXIT_SUCCESS;
 }
 
 
+// Tuned local sizes are kept per device, driver, element type, kernel and vector width (in testName), and array
+// size, since the best work-group size of a small array that fits in cache needn't be that of a large one
+void GetTuningKey(cl_device_id *device, const char *testName, size_t arraySize, char *key, size_t keyLength)
+{
+	cl_platform_id platform;
+	char platformName[256], deviceName[256], driverVersion[256];
+
+	clGetDeviceInfo(*device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+	clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(platformName), platformName, NULL);
+	clGetDeviceInfo(*device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+	clGetDeviceInfo(*device, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL);
+
+	snprintf(key, keyLength, "%s|%s|%s|%s|%s|%zu", platformName, deviceName, driverVersion,
+	         elementTypes[elementType].name, testName, arraySize);
+}
+
+
+
+// The tuning file has one line per entry: the key, a tab, and the local size. A missing file is an empty one.
+void LoadTuningFile(void)
+{
+	char line[1100];
+
+	if (tuningFile == NULL) return;
+	FILE *fp = fopen(tuningFile, "r");
+	if (fp == NULL) return;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *tab = strrchr(line, '\t');
+		size_t localSize;
+		if (tab == NULL || sscanf(tab + 1, "%zu", &localSize) != 1) continue;
+		*tab = '\0';
+		if (strlen(line) >= sizeof(tuningEntries[0].key)) continue;
+
+		tuningEntries = realloc(tuningEntries, (nTuningEntries + 1)*sizeof(TuningEntry));
+		strcpy(tuningEntries[nTuningEntries].key, line);
+		tuningEntries[nTuningEntries].localSize = localSize;
+		nTuningEntries++;
+	}
+	fclose(fp);
+}
+
+
+
+int LookupTuning(const char *key, size_t *localSize)
+{
+	for (int i = nTuningEntries - 1; i >= 0; i--) {
+		if (strcmp(tuningEntries[i].key, key) == 0) {
+			*localSize = tuningEntries[i].localSize;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+
+// Replace the entry for key, or add it. The file is read again and rewritten without the old entries for key, so
+// it keeps the entries of other devices and of runs that saved since this one loaded it, and doesn't grow with each
+// --retune. As in the program cache, it is written to a temporary file and renamed, so no run reads a partial file.
+void SaveTuning(const char *key, size_t localSize)
+{
+	int i = 0;
+	while (i < nTuningEntries && strcmp(tuningEntries[i].key, key) != 0) i++;
+	if (i == nTuningEntries) {
+		tuningEntries = realloc(tuningEntries, (nTuningEntries + 1)*sizeof(TuningEntry));
+		snprintf(tuningEntries[i].key, sizeof(tuningEntries[i].key), "%s", key);
+		nTuningEntries++;
+	}
+	tuningEntries[i].localSize = localSize;
+
+	if (tuningFile == NULL) return;
+	char tmpFile[1100], line[1100];
+	snprintf(tmpFile, sizeof(tmpFile), "%s.XXXXXX", tuningFile);
+	int fd = mkstemp(tmpFile);
+	FILE *out = (fd < 0 ? NULL : fdopen(fd, "w"));
+	if (out == NULL) {
+		printf("Can't write tuning file %s\n", tuningFile);
+		if (fd >= 0) {
+			close(fd);
+			remove(tmpFile);
+		}
+		return;
+	}
+	fchmod(fd, 0644);
+
+	FILE *in = fopen(tuningFile, "r");
+	if (in != NULL) {
+		while (fgets(line, sizeof(line), in) != NULL) {
+			char *tab = strrchr(line, '\t');
+			if (tab != NULL && (size_t)(tab - line) == strlen(key) && strncmp(line, key, tab - line) == 0) continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s\t%zu\n", key, localSize);
+	if (fclose(out) != 0 || rename(tmpFile, tuningFile) != 0) {
+		printf("Can't write tuning file %s\n", tuningFile);
+		remove(tmpFile);
+	}
+}
+
+
+
+
+// Return whether the device lists the extension in CL_DEVICE_EXTENSIONS
+int DeviceHasExtension(cl_device_id *device, const char *extension)
+{
+	size_t length;
+	clGetDeviceInfo(*device, CL_DEVICE_EXTENSIONS, 0, NULL, &length);
+	char *extensions = malloc(length + 2);
+	extensions[0] = ' ';
+	clGetDeviceInfo(*device, CL_DEVICE_EXTENSIONS, length, extensions + 1, NULL);
+	strcat(extensions, " ");
+
+	// Extensions are space separated, match whole names only
+	char name[128];
+	snprintf(name, sizeof(name), " %s ", extension);
+	int found = (strstr(extensions, name) != NULL);
+	free(extensions);
+	return found;
+}
+
+
+
 
-void CleanUpCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id, cl_context *context, cl_command_queue *queue, cl_program *program)
+void CleanUpCLEnvironment(cl_platform_id **platform, cl_device_id ***device_id, cl_context *context, cl_command_queue *queue)
 {
 	//release CL resources
-	clReleaseProgram(*program);
 	clReleaseCommandQueue(*queue);
 	clReleaseContext(*context);
 